@@ -0,0 +1,105 @@
+#include "AlignedBuffer.h"
+#include <cstdlib>
+#include <cassert>
+
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "ChiliWin.h"
+#include <malloc.h>
+
+namespace
+{
+	// large pages need the lock pages in memory privilege, which only gets enabled
+	// if the account holds it (otherwise every huge page request falls back)
+	bool EnableLargePages()
+	{
+		HANDLE hToken = nullptr;
+		if( !OpenProcessToken( GetCurrentProcess(),TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY,&hToken ) )
+		{
+			return false;
+		}
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1u;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		const bool ok = LookupPrivilegeValueW( nullptr,L"SeLockMemoryPrivilege",&privileges.Privileges[0].Luid ) &&
+			AdjustTokenPrivileges( hToken,FALSE,&privileges,0u,nullptr,nullptr ) &&
+			GetLastError() == ERROR_SUCCESS;
+		CloseHandle( hToken );
+		return ok && GetLargePageMinimum() > 0u;
+	}
+}
+
+void* AlignedBuffer::AllocateBytes( size_t size,size_t alignment,bool tryHugePages,bool& gotHugePages )
+{
+	assert( (alignment & (alignment - 1u)) == 0u );
+	gotHugePages = false;
+	if( tryHugePages )
+	{
+		static const bool largePagesEnabled = EnableLargePages();
+		const size_t pageSize = GetLargePageMinimum();
+		if( largePagesEnabled && size >= pageSize && alignment <= pageSize )
+		{
+			void* const p = VirtualAlloc( nullptr,(size + pageSize - 1u) / pageSize * pageSize,
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,PAGE_READWRITE );
+			if( p )
+			{
+				gotHugePages = true;
+				return p;
+			}
+		}
+	}
+	void* const p = _aligned_malloc( size > 0u ? size : 1u,alignment );
+	if( !p )
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void AlignedBuffer::Free( void* p,bool hugePages )
+{
+	if( hugePages )
+	{
+		VirtualFree( p,0u,MEM_RELEASE );
+	}
+	else
+	{
+		_aligned_free( p );
+	}
+}
+#else
+#include <sys/mman.h>
+
+void* AlignedBuffer::AllocateBytes( size_t size,size_t alignment,bool tryHugePages,bool& gotHugePages )
+{
+	assert( (alignment & (alignment - 1u)) == 0u );
+	// transparent huge pages only back 2mb aligned ranges
+	constexpr size_t HugePageSize = size_t( 2u ) << 20u;
+	gotHugePages = false;
+	if( tryHugePages && size >= HugePageSize && alignment < HugePageSize )
+	{
+		// whole pages, so the advice below only covers this allocation
+		alignment = HugePageSize;
+		size = (size + HugePageSize - 1u) / HugePageSize * HugePageSize;
+	}
+	void* p = nullptr;
+	if( posix_memalign( &p,alignment,size > 0u ? size : 1u ) != 0 )
+	{
+		throw std::bad_alloc();
+	}
+#ifdef MADV_HUGEPAGE
+	if( alignment == HugePageSize )
+	{
+		// only advice, the kernel may still use small pages
+		gotHugePages = madvise( p,size,MADV_HUGEPAGE ) == 0;
+	}
+#endif
+	return p;
+}
+
+void AlignedBuffer::Free( void* p,bool )
+{
+	// huge pages came from posix_memalign too
+	std::free( p );
+}
+#endif
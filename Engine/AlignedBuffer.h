@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+
+// heap arrays aligned to a cache line (or more)
+// big buffers that are streamed through every frame can ask for huge pages, which cuts
+// the tlb misses of walking them, if the os does not grant them normal pages are used
+class AlignedBuffer
+{
+public:
+	static constexpr size_t CacheLine = 64u;
+	// frees with whatever the memory came from
+	class Deleter
+	{
+	public:
+		Deleter() = default;
+		Deleter( bool hugePages )
+			:
+			hugePages( hugePages )
+		{}
+		void operator()( void* p ) const
+		{
+			Free( p,hugePages );
+		}
+		bool UsesHugePages() const
+		{
+			return hugePages;
+		}
+	private:
+		bool hugePages = false;
+	};
+	template<typename T>
+	using Pointer = std::unique_ptr<T[],Deleter>;
+public:
+	// count value initialized elements (alignment is a power of two, at least sizeof( void* ))
+	template<typename T>
+	static Pointer<T> Allocate( size_t count,size_t alignment = CacheLine,bool tryHugePages = false )
+	{
+		static_assert( std::is_trivially_destructible<T>::value,"elements are never destroyed" );
+		bool gotHugePages = false;
+		T* const p = static_cast<T*>( AllocateBytes( count * sizeof( T ),alignment,tryHugePages,gotHugePages ) );
+		for( size_t i = 0u; i < count; i++ )
+		{
+			new( p + i ) T();
+		}
+		return Pointer<T>( p,Deleter( gotHugePages ) );
+	}
+private:
+	// throws std::bad_alloc
+	static void* AllocateBytes( size_t size,size_t alignment,bool tryHugePages,bool& gotHugePages );
+	static void Free( void* p,bool hugePages );
+};
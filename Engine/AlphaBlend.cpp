@@ -0,0 +1,234 @@
+#include "AlphaBlend.h"
+#include <immintrin.h>
+#include <cstring>
+#include <cstdint>
+
+namespace
+{
+	// x / 255 rounded, exact for x <= 255 * 255
+	unsigned int Div255( unsigned int x )
+	{
+		x += 128u;
+		return (x + (x >> 8u)) >> 8u;
+	}
+	unsigned int SaturateAdd( unsigned int a,unsigned int b )
+	{
+		const unsigned int sum = a + b;
+		return sum > 255u ? 255u : sum;
+	}
+	__m128i Div255( __m128i x )
+	{
+		x = _mm_add_epi16( x,_mm_set1_epi16( 128 ) );
+		return _mm_srli_epi16( _mm_add_epi16( x,_mm_srli_epi16( x,8 ) ),8 );
+	}
+
+#if defined( __AVX2__ )
+	// same as the sse2 kernel below, 2 x 4 pixels per step
+	// (unpack and pack work within 128 bit lanes, so the pixel order is kept)
+	__m256i Div255( __m256i x )
+	{
+		x = _mm256_add_epi16( x,_mm256_set1_epi16( 128 ) );
+		return _mm256_srli_epi16( _mm256_add_epi16( x,_mm256_srli_epi16( x,8 ) ),8 );
+	}
+	__m256i BroadcastAlpha( __m256i x )
+	{
+		return _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( x,0xFF ),0xFF );
+	}
+	template<AlphaBlend::Mode mode>
+	size_t BlendBlocks( Color* pDst,const Color* pSrc,size_t count )
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i alphaMask = _mm256_set1_epi32( int( 0xFF000000u ) );
+		const __m256i c255 = _mm256_set1_epi16( 255 );
+		// factor for the source channels in straight mode: (a,a,a,255)
+		const __m256i colorLanes = _mm256_set1_epi64x( 0x0000FFFFFFFFFFFFll );
+		const __m256i alphaLane = _mm256_set1_epi64x( 0x00FF000000000000ll );
+		size_t i = 0u;
+		for( ; i + 8u <= count; i += 8u )
+		{
+			const __m256i s = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc + i ) );
+			const __m256i sa = _mm256_and_si256( s,alphaMask );
+			if( _mm256_movemask_epi8( _mm256_cmpeq_epi32( sa,alphaMask ) ) == -1 )
+			{
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDst + i ),s );
+				continue;
+			}
+			if( _mm256_movemask_epi8( _mm256_cmpeq_epi32( mode == AlphaBlend::Mode::Straight ? sa : s,zero ) ) == -1 )
+			{
+				continue;
+			}
+			const __m256i d = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDst + i ) );
+			const __m256i sLo = _mm256_unpacklo_epi8( s,zero );
+			const __m256i sHi = _mm256_unpackhi_epi8( s,zero );
+			const __m256i aLo = BroadcastAlpha( sLo );
+			const __m256i aHi = BroadcastAlpha( sHi );
+			__m256i lo = _mm256_mullo_epi16( _mm256_unpacklo_epi8( d,zero ),_mm256_sub_epi16( c255,aLo ) );
+			__m256i hi = _mm256_mullo_epi16( _mm256_unpackhi_epi8( d,zero ),_mm256_sub_epi16( c255,aHi ) );
+			if( mode == AlphaBlend::Mode::Straight )
+			{
+				lo = _mm256_add_epi16( lo,_mm256_mullo_epi16( sLo,_mm256_or_si256( _mm256_and_si256( aLo,colorLanes ),alphaLane ) ) );
+				hi = _mm256_add_epi16( hi,_mm256_mullo_epi16( sHi,_mm256_or_si256( _mm256_and_si256( aHi,colorLanes ),alphaLane ) ) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDst + i ),_mm256_packus_epi16( Div255( lo ),Div255( hi ) ) );
+			}
+			else
+			{
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDst + i ),
+					_mm256_adds_epu8( s,_mm256_packus_epi16( Div255( lo ),Div255( hi ) ) ) );
+			}
+		}
+		return i;
+	}
+#else
+	// copies the alpha of each pixel (16 bit lanes b,g,r,a) to all four of its lanes
+	__m128i BroadcastAlpha( __m128i x )
+	{
+		return _mm_shufflehi_epi16( _mm_shufflelo_epi16( x,0xFF ),0xFF );
+	}
+	// blends whole blocks of 4 pixels, returns the number of pixels done
+	// channels are widened to 16 bits, so the products (at most 255 * 255) do not overflow
+	template<AlphaBlend::Mode mode>
+	size_t BlendBlocks( Color* pDst,const Color* pSrc,size_t count )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alphaMask = _mm_set1_epi32( int( 0xFF000000u ) );
+		const __m128i c255 = _mm_set1_epi16( 255 );
+		// factor for the source channels in straight mode: (a,a,a,255)
+		const __m128i colorLanes = _mm_set_epi32( 0x0000FFFF,int( 0xFFFFFFFFu ),0x0000FFFF,int( 0xFFFFFFFFu ) );
+		const __m128i alphaLane = _mm_set_epi32( 0x00FF0000,0,0x00FF0000,0 );
+		size_t i = 0u;
+		for( ; i + 4u <= count; i += 4u )
+		{
+			const __m128i s = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + i ) );
+			const __m128i sa = _mm_and_si128( s,alphaMask );
+			// opaque block: plain copy
+			if( _mm_movemask_epi8( _mm_cmpeq_epi32( sa,alphaMask ) ) == 0xFFFF )
+			{
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( pDst + i ),s );
+				continue;
+			}
+			// transparent block: nothing to do (premultiplied pixels must be all zero)
+			if( _mm_movemask_epi8( _mm_cmpeq_epi32( mode == AlphaBlend::Mode::Straight ? sa : s,zero ) ) == 0xFFFF )
+			{
+				continue;
+			}
+			const __m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDst + i ) );
+			const __m128i sLo = _mm_unpacklo_epi8( s,zero );
+			const __m128i sHi = _mm_unpackhi_epi8( s,zero );
+			const __m128i aLo = BroadcastAlpha( sLo );
+			const __m128i aHi = BroadcastAlpha( sHi );
+			__m128i lo = _mm_mullo_epi16( _mm_unpacklo_epi8( d,zero ),_mm_sub_epi16( c255,aLo ) );
+			__m128i hi = _mm_mullo_epi16( _mm_unpackhi_epi8( d,zero ),_mm_sub_epi16( c255,aHi ) );
+			if( mode == AlphaBlend::Mode::Straight )
+			{
+				lo = _mm_add_epi16( lo,_mm_mullo_epi16( sLo,_mm_or_si128( _mm_and_si128( aLo,colorLanes ),alphaLane ) ) );
+				hi = _mm_add_epi16( hi,_mm_mullo_epi16( sHi,_mm_or_si128( _mm_and_si128( aHi,colorLanes ),alphaLane ) ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( pDst + i ),_mm_packus_epi16( Div255( lo ),Div255( hi ) ) );
+			}
+			else
+			{
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( pDst + i ),
+					_mm_adds_epu8( s,_mm_packus_epi16( Div255( lo ),Div255( hi ) ) ) );
+			}
+		}
+		return i;
+	}
+#endif
+
+	// lerps 4 pixels toward c by their weights (channels widened to 16 bits)
+	__m128i LerpBlock( __m128i d,uint32_t coverage,__m128i src )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c255 = _mm_set1_epi16( 255 );
+		// w0 w0 w1 w1 w2 w2 w3 w3, then each weight in the 4 lanes of its pixel
+		const __m128i w = _mm_unpacklo_epi8( _mm_cvtsi32_si128( int( coverage ) ),zero );
+		const __m128i ww = _mm_unpacklo_epi16( w,w );
+		const __m128i wLo = _mm_unpacklo_epi32( ww,ww );
+		const __m128i wHi = _mm_unpackhi_epi32( ww,ww );
+		const __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( d,zero ),_mm_sub_epi16( c255,wLo ) ),
+			_mm_mullo_epi16( src,wLo ) );
+		const __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( d,zero ),_mm_sub_epi16( c255,wHi ) ),
+			_mm_mullo_epi16( src,wHi ) );
+		return _mm_packus_epi16( Div255( lo ),Div255( hi ) );
+	}
+}
+
+void AlphaBlend::BlendSpan( Color* pDst,const Color* pSrc,size_t count,Mode mode )
+{
+	const size_t done = mode == Mode::Straight ?
+		BlendBlocks<Mode::Straight>( pDst,pSrc,count ) :
+		BlendBlocks<Mode::Premultiplied>( pDst,pSrc,count );
+	for( size_t i = done; i < count; i++ )
+	{
+		pDst[i] = BlendPixel( pDst[i],pSrc[i],mode );
+	}
+}
+
+void AlphaBlend::BlendCoverage( Color* pBase,const unsigned int* pOffsets,const unsigned char* pCoverage,
+	size_t count,Color c )
+{
+	// the pixels are scattered, so they are gathered into blocks of 4, blended with sse2
+	// (in both builds) and scattered back
+	// c in the 16 bit lanes of 2 pixels
+	const __m128i src = _mm_unpacklo_epi8( _mm_set1_epi32( int( c.dword ) ),_mm_setzero_si128() );
+	for( size_t i = 0u; i < count; i += 4u )
+	{
+		const unsigned int* pBlockOffsets = pOffsets + i;
+		uint32_t coverage = 0u;
+		unsigned int tailOffsets[4];
+		if( count - i >= 4u )
+		{
+			memcpy( &coverage,pCoverage + i,sizeof( coverage ) );
+		}
+		else
+		{
+			// the last 1 to 3 pixels are padded with the first of them at zero weight
+			// (the block is written back from the last pixel, so the blended one lands on top)
+			memcpy( &coverage,pCoverage + i,count - i );
+			for( size_t j = 0u; j < 4u; j++ )
+			{
+				tailOffsets[j] = pOffsets[i + (i + j < count ? j : 0u)];
+			}
+			pBlockOffsets = tailOffsets;
+		}
+		Color* const p0 = pBase + pBlockOffsets[0];
+		Color* const p1 = pBase + pBlockOffsets[1];
+		Color* const p2 = pBase + pBlockOffsets[2];
+		Color* const p3 = pBase + pBlockOffsets[3];
+		const __m128i d = _mm_set_epi32( int( p3->dword ),int( p2->dword ),int( p1->dword ),int( p0->dword ) );
+		const __m128i r = LerpBlock( d,coverage,src );
+		p3->dword = (unsigned int)( _mm_cvtsi128_si32( _mm_srli_si128( r,12 ) ) );
+		p2->dword = (unsigned int)( _mm_cvtsi128_si32( _mm_srli_si128( r,8 ) ) );
+		p1->dword = (unsigned int)( _mm_cvtsi128_si32( _mm_srli_si128( r,4 ) ) );
+		p0->dword = (unsigned int)( _mm_cvtsi128_si32( r ) );
+	}
+}
+
+void AlphaBlend::Premultiply( Color* pPixels,size_t count )
+{
+	for( size_t i = 0u; i < count; i++ )
+	{
+		const Color c = pPixels[i];
+		const unsigned int a = c.GetA();
+		pPixels[i] = Color( (unsigned char)a,(unsigned char)Div255( c.GetR() * a ),
+			(unsigned char)Div255( c.GetG() * a ),(unsigned char)Div255( c.GetB() * a ) );
+	}
+}
+
+Color AlphaBlend::BlendPixel( Color dst,Color src,Mode mode )
+{
+	const unsigned int a = src.GetA();
+	const unsigned int ia = 255u - a;
+	if( mode == Mode::Straight )
+	{
+		return Color(
+			(unsigned char)Div255( a * 255u + dst.GetA() * ia ),
+			(unsigned char)Div255( src.GetR() * a + dst.GetR() * ia ),
+			(unsigned char)Div255( src.GetG() * a + dst.GetG() * ia ),
+			(unsigned char)Div255( src.GetB() * a + dst.GetB() * ia ) );
+	}
+	return Color(
+		(unsigned char)SaturateAdd( src.GetA(),Div255( dst.GetA() * ia ) ),
+		(unsigned char)SaturateAdd( src.GetR(),Div255( dst.GetR() * ia ) ),
+		(unsigned char)SaturateAdd( src.GetG(),Div255( dst.GetG() * ia ) ),
+		(unsigned char)SaturateAdd( src.GetB(),Div255( dst.GetB() * ia ) ) );
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Colors.h"
+#include <cstddef>
+
+// source-over blending of pixel spans
+// 4 (sse2) or 8 (avx2) pixels per step, blocks that are fully opaque are copied
+// and fully transparent ones skipped, so sprites with large solid or empty areas
+// cost little more than a copy
+class AlphaBlend
+{
+public:
+	enum class Mode
+	{
+		// dst = src * a + dst * (1 - a), alpha becomes a + dstA * (1 - a)
+		Straight,
+		// color is already multiplied by alpha: dst = src + dst * (1 - a) (saturated)
+		// (a pixel with zero alpha but some color adds light)
+		Premultiplied
+	};
+public:
+	static void BlendSpan( Color* pDst,const Color* pSrc,size_t count,Mode mode );
+	// moves pBase[pOffsets[i]] toward c by pCoverage[i] (0 keeps it, 255 replaces it with c), all four channels
+	// (the pixels of an anti-aliased line, weighted by how much of each the line covers)
+	// the pixels are blended in blocks of 4 (pOffsets[0..3], pOffsets[4..7], ...), an offset must not appear
+	// twice in one block, except at zero coverage after its other appearance (it is written back last to first)
+	static void BlendCoverage( Color* pBase,const unsigned int* pOffsets,const unsigned char* pCoverage,
+		size_t count,Color c );
+	// converts straight alpha to premultiplied in place
+	static void Premultiply( Color* pPixels,size_t count );
+	// single pixel version of BlendSpan (same results as the simd kernels)
+	static Color BlendPixel( Color dst,Color src,Mode mode );
+};
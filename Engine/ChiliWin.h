@@ -20,6 +20,7 @@
 ******************************************************************************************/
 #pragma once
 
+#ifdef _WIN32
 // target Windows 7 or later
 #define _WIN32_WINNT 0x0601
 #include <sdkddkver.h>
@@ -67,4 +68,13 @@
 
 #define STRICT
 
-#include <Windows.h>
\ No newline at end of file
+#include <Windows.h>
+#else
+// the few windows names the portable parts of the engine use
+#include <cstdint>
+typedef unsigned char BYTE;
+#ifndef _CRT_WIDE
+#define _CRT_WIDE_( s ) L ## s
+#define _CRT_WIDE( s ) _CRT_WIDE_( s )
+#endif
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Scene.h"
+#include "Cube.h"
+#include "Mat3.h"
+#include "Pipeline.h"
+#include "SolidEffect.h"
+#include <vector>
+
+// grid of 100 x 3 x 100 solid cubes, all drawn with one instanced draw
+class CubeGridScene : public Scene
+{
+public:
+	typedef ::Pipeline<SolidEffect> Pipeline;
+	typedef Pipeline::Vertex Vertex;
+	typedef SolidEffect::Instance Instance;
+public:
+	CubeGridScene( Graphics& gfx )
+		:
+		Scene( "Instanced cube grid scene" ),
+		itlist( Cube::GetPlain<Vertex>( cubeSize ) ),
+		pipeline( gfx )
+	{
+		const Color colors[] = {
+			Colors::Red,Colors::Green,Colors::Blue,Colors::Magenta,Colors::Yellow,Colors::Cyan
+		};
+
+		for( int i = 0; i < gridWidth; i++ )
+		{
+			for( int j = 0; j < gridHeight; j++ )
+			{
+				for( int k = 0; k < gridDepth; k++ )
+				{
+					positions.emplace_back(
+						float( i - gridWidth / 2 ) * cubeSpacing,
+						float( j ) * cubeSpacing,
+						float( k - gridDepth / 2 ) * cubeSpacing
+					);
+					instances.emplace_back();
+					instances.back().color = colors[(i + j + k) % 6];
+				}
+			}
+		}
+		pipeline.SetClipPlanes( 0.1f,200.0f );
+		pipeline.SetRasterMode( Pipeline::RasterMode::Binned );
+	}
+	virtual void Update( Keyboard& kbd,Mouse&,float dt ) override
+	{
+		if( kbd.KeyIsPressed( 'Q' ) )
+		{
+			yaw = wrap_angle( yaw + dTheta * dt );
+		}
+		if( kbd.KeyIsPressed( 'E' ) )
+		{
+			yaw = wrap_angle( yaw - dTheta * dt );
+		}
+		// move along the view direction in the ground plane
+		const Vec3 forward = { -sin( yaw ),0.0f,cos( yaw ) };
+		const Vec3 right = { cos( yaw ),0.0f,sin( yaw ) };
+		if( kbd.KeyIsPressed( 'W' ) )
+		{
+			camPos += forward * (moveSpeed * dt);
+		}
+		if( kbd.KeyIsPressed( 'S' ) )
+		{
+			camPos -= forward * (moveSpeed * dt);
+		}
+		if( kbd.KeyIsPressed( 'D' ) )
+		{
+			camPos += right * (moveSpeed * dt);
+		}
+		if( kbd.KeyIsPressed( 'A' ) )
+		{
+			camPos -= right * (moveSpeed * dt);
+		}
+		if( kbd.KeyIsPressed( 'R' ) )
+		{
+			camPos.y += moveSpeed * dt;
+		}
+		if( kbd.KeyIsPressed( 'F' ) )
+		{
+			camPos.y -= moveSpeed * dt;
+		}
+	}
+	virtual void Draw() override
+	{
+		pipeline.BeginFrame();
+		// cubes are not rotated, so every instance gets the camera rotation
+		// and its position relative to the camera
+		const Mat3 camRot = Mat3::RotationY( yaw );
+		for( size_t i = 0; i < instances.size(); i++ )
+		{
+			instances[i].rotation = camRot;
+			instances[i].translation = (positions[i] - camPos) * camRot;
+		}
+		// render all cubes in one draw
+		pipeline.DrawInstanced( itlist,instances );
+		pipeline.EndFrame();
+	}
+private:
+	static constexpr int gridWidth = 100;
+	static constexpr int gridHeight = 3;
+	static constexpr int gridDepth = 100;
+	static constexpr float cubeSize = 1.0f;
+	static constexpr float cubeSpacing = 2.0f;
+	IndexedTriangleList<Vertex> itlist;
+	Pipeline pipeline;
+	std::vector<Vec3> positions;
+	std::vector<Instance> instances;
+	static constexpr float dTheta = PI;
+	static constexpr float moveSpeed = 10.0f;
+	Vec3 camPos = { 0.0f,2.0f,-10.0f };
+	float yaw = 0.0f;
+};
@@ -10,7 +10,7 @@
 class CubeSkinScene : public Scene
 {
 public:
-	typedef Pipeline<TextureEffect> Pipeline;
+	typedef ::Pipeline<TextureEffect> Pipeline;
 	typedef Pipeline::Vertex Vertex;
 public:
 	CubeSkinScene( Graphics& gfx,const std::wstring& filename )
@@ -21,6 +21,15 @@ public:
 	{
 		pipeline.effect.ps.BindTexture( filename );
 	}
+	// takes a texture that was already loaded (name is just for the scene title)
+	CubeSkinScene( Graphics& gfx,Texture texture,const std::wstring& name )
+		:
+		itlist( Cube::GetSkinned<Vertex>() ),
+		pipeline( gfx ),
+		Scene( "Textured Cube skinned using texture: " + std::string( name.begin(),name.end() ) )
+	{
+		pipeline.effect.ps.BindTexture( std::move( texture ) );
+	}
 	virtual void Update( Keyboard& kbd,Mouse& mouse,float dt ) override
 	{
 		if( kbd.KeyIsPressed( 'Q' ) )
@@ -58,6 +67,7 @@ public:
 	}
 	virtual void Draw() override
 	{
+		pipeline.BeginFrame();
 		// generate rotation matrix from euler angles
 		// translation from offset
 		const Mat3 rot =
@@ -70,6 +80,7 @@ public:
 		pipeline.BindTranslation( trans );
 		// render triangles
 		pipeline.Draw( itlist );
+		pipeline.EndFrame();
 	}
 private:
 	IndexedTriangleList<Vertex> itlist;
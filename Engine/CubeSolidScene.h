@@ -9,7 +9,7 @@
 class CubeSolidScene : public Scene
 {
 public:
-	typedef Pipeline<SolidEffect> Pipeline;
+	typedef ::Pipeline<SolidEffect> Pipeline;
 	typedef Pipeline::Vertex Vertex;
 public:
 	CubeSolidScene( Graphics& gfx )
@@ -22,10 +22,13 @@ public:
 			Colors::Red,Colors::Green,Colors::Blue,Colors::Magenta,Colors::Yellow,Colors::Cyan
 		};
 
-		for( int i = 0; i < itlist.vertices.size(); i++ )
+		itlist.EditVertices( [&colors]( std::vector<Vertex>& vertices )
 		{
-			itlist.vertices[i].color = colors[i / 4];
-		}
+			for( size_t i = 0; i < vertices.size(); i++ )
+			{
+				vertices[i].color = colors[i / 4];
+			}
+		} );
 	}
 	virtual void Update( Keyboard& kbd,Mouse& mouse,float dt ) override
 	{
@@ -64,6 +67,7 @@ public:
 	}
 	virtual void Draw() override
 	{
+		pipeline.BeginFrame();
 		// generate rotation matrix from euler angles
 		// translation from offset
 		const Mat3 rot =
@@ -76,6 +80,7 @@ public:
 		pipeline.BindTranslation( trans );
 		// render triangles
 		pipeline.Draw( itlist );
+		pipeline.EndFrame();
 	}
 private:
 	IndexedTriangleList<Vertex> itlist;
@@ -9,7 +9,7 @@
 class CubeVertexColorScene : public Scene
 {
 public:
-	typedef Pipeline<VertexColorEffect> Pipeline;
+	typedef ::Pipeline<VertexColorEffect> Pipeline;
 	typedef Pipeline::Vertex Vertex;
 public:
 	CubeVertexColorScene( Graphics& gfx )
@@ -18,14 +18,17 @@ public:
 		pipeline( gfx ),
 		Scene( "Colored cube vertex gradient scene" )
 	{
-		itlist.vertices[0].color = Vec3( Colors::Red );
-		itlist.vertices[1].color = Vec3( Colors::Green );
-		itlist.vertices[2].color = Vec3( Colors::Blue );
-		itlist.vertices[3].color = Vec3( Colors::Yellow );
-		itlist.vertices[4].color = Vec3( Colors::Cyan );
-		itlist.vertices[5].color = Vec3( Colors::Magenta );
-		itlist.vertices[6].color = Vec3( Colors::White );
-		itlist.vertices[7].color = Vec3( Colors::Black );
+		itlist.EditVertices( []( std::vector<Vertex>& vertices )
+		{
+			vertices[0].color = Vec3( Colors::Red );
+			vertices[1].color = Vec3( Colors::Green );
+			vertices[2].color = Vec3( Colors::Blue );
+			vertices[3].color = Vec3( Colors::Yellow );
+			vertices[4].color = Vec3( Colors::Cyan );
+			vertices[5].color = Vec3( Colors::Magenta );
+			vertices[6].color = Vec3( Colors::White );
+			vertices[7].color = Vec3( Colors::Black );
+		} );
 	}
 	virtual void Update( Keyboard& kbd,Mouse& mouse,float dt ) override
 	{
@@ -64,6 +67,7 @@ public:
 	}
 	virtual void Draw() override
 	{
+		pipeline.BeginFrame();
 		// generate rotation matrix from euler angles
 		// translation from offset
 		const Mat3 rot =
@@ -76,6 +80,7 @@ public:
 		pipeline.BindTranslation( trans );
 		// render triangles
 		pipeline.Draw( itlist );
+		pipeline.EndFrame();
 	}
 private:
 	IndexedTriangleList<Vertex> itlist;
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "IndexedTriangleList.h"
+#include "ChiliMath.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+// unique edges of an indexed triangle mesh, for drawing it as a wireframe
+// built once per mesh, then every frame the vertices are transformed once
+// and each edge is drawn once (instead of once per triangle that uses it)
+// triangles are expected to be wound consistently (needed for the silhouette test)
+class EdgeList
+{
+public:
+	// face index of the missing neighbor of an edge on a mesh boundary
+	static constexpr uint32_t NoFace = UINT32_MAX;
+	class Edge
+	{
+	public:
+		// vertex indices (v0 < v1)
+		uint32_t v0;
+		uint32_t v1;
+		// the triangles on either side
+		uint32_t face0;
+		uint32_t face1;
+	};
+	enum class Filter
+	{
+		// every edge of every triangle
+		All,
+		// edges where the surface bends by more than the crease angle, and boundary edges
+		// (drops the diagonals that split flat quads into triangles)
+		Feature
+	};
+public:
+	template<class T,class I>
+	EdgeList( const IndexedTriangleList<T,I>& mesh,Filter filter = Filter::All,float creaseAngle = PI / 18.0f )
+		:
+		nVertices( mesh.GetVertices().size() ),
+		faces( mesh.indices.begin(),mesh.indices.end() )
+	{
+		// every triangle side as (smaller vertex,larger vertex,face), sorted so the
+		// sides of neighboring triangles that make up one edge end up next to each other
+		class Side
+		{
+		public:
+			bool operator<( const Side& rhs ) const
+			{
+				return key < rhs.key;
+			}
+		public:
+			uint64_t key;
+			uint32_t face;
+		};
+		std::vector<Side> sides;
+		sides.reserve( faces.size() );
+		for( size_t i = 0; i < faces.size(); i += 3u )
+		{
+			for( size_t j = 0; j < 3u; j++ )
+			{
+				const uint32_t a = faces[i + j];
+				const uint32_t b = faces[i + (j + 1u) % 3u];
+				sides.push_back( { uint64_t( std::min( a,b ) ) << 32 | std::max( a,b ),uint32_t( i / 3u ) } );
+			}
+		}
+		std::sort( sides.begin(),sides.end() );
+
+		const float cosCrease = std::cos( creaseAngle );
+		for( size_t i = 0; i < sides.size(); )
+		{
+			size_t end = i + 1u;
+			while( end < sides.size() && sides[end].key == sides[i].key )
+			{
+				end++;
+			}
+			Edge e;
+			e.v0 = uint32_t( sides[i].key >> 32 );
+			e.v1 = uint32_t( sides[i].key );
+			e.face0 = sides[i].face;
+			e.face1 = end - i == 2u ? sides[i + 1u].face : NoFace;
+			// boundary and non manifold edges (shared by more than 2 triangles) are always features
+			const bool keep = filter == Filter::All || end - i != 2u ||
+				Dot( GetNormal( mesh,e.face0 ),GetNormal( mesh,e.face1 ) ) < cosCrease;
+			if( keep )
+			{
+				edges.push_back( e );
+			}
+			i = end;
+		}
+	}
+	const std::vector<Edge>& GetEdges() const
+	{
+		return edges;
+	}
+	size_t GetVertexCount() const
+	{
+		return nVertices;
+	}
+	// fills edgeIndices with the edges on the outline as seen from eye: one side faces the eye
+	// and the other faces away, or the edge is on a boundary
+	// positions are the vertices transformed into the same space as eye (P has x,y,z)
+	template<class P>
+	void GetSilhouette( const P* pPositions,const P& eye,std::vector<uint32_t>& edgeIndices ) const
+	{
+		edgeIndices.clear();
+		for( size_t i = 0; i < edges.size(); i++ )
+		{
+			const Edge& e = edges[i];
+			if( e.face1 == NoFace || FacesEye( pPositions,e.face0,eye ) != FacesEye( pPositions,e.face1,eye ) )
+			{
+				edgeIndices.push_back( uint32_t( i ) );
+			}
+		}
+	}
+private:
+	template<class T,class I>
+	static Vec3 GetNormal( const IndexedTriangleList<T,I>& mesh,uint32_t face )
+	{
+		const Vec3& p0 = mesh.GetVertices()[mesh.indices[face * 3u]].pos;
+		const Vec3& p1 = mesh.GetVertices()[mesh.indices[face * 3u + 1u]].pos;
+		const Vec3& p2 = mesh.GetVertices()[mesh.indices[face * 3u + 2u]].pos;
+		return ((p1 - p0) % (p2 - p0)).GetNormalized();
+	}
+	static float Dot( const Vec3& a,const Vec3& b )
+	{
+		return a * b;
+	}
+	template<class P>
+	bool FacesEye( const P* pPositions,uint32_t face,const P& eye ) const
+	{
+		const P& p0 = pPositions[faces[face * 3u]];
+		const P& p1 = pPositions[faces[face * 3u + 1u]];
+		const P& p2 = pPositions[faces[face * 3u + 2u]];
+		// (p1 - p0) x (p2 - p0) dotted with (eye - p0), written out for any vector type
+		const float ax = float( p1.x - p0.x ),ay = float( p1.y - p0.y ),az = float( p1.z - p0.z );
+		const float bx = float( p2.x - p0.x ),by = float( p2.y - p0.y ),bz = float( p2.z - p0.z );
+		const float ex = float( eye.x - p0.x ),ey = float( eye.y - p0.y ),ez = float( eye.z - p0.z );
+		return (ay * bz - az * by) * ex + (az * bx - ax * bz) * ey + (ax * by - ay * bx) * ez > 0.0f;
+	}
+private:
+	size_t nVertices;
+	// 3 vertex indices per triangle, for the silhouette test
+	std::vector<uint32_t> faces;
+	std::vector<Edge> edges;
+};
@@ -0,0 +1,105 @@
+#include "FastClear.h"
+#include <algorithm>
+
+FastClear::FastClear( unsigned int width,unsigned int height )
+	:
+	width( width ),
+	height( height ),
+	tilesX( (width + TileSize - 1u) / TileSize ),
+	tilesY( (height + TileSize - 1u) / TileSize ),
+	masks( size_t( height ) * tilesX,0u ),
+	tilePending( size_t( tilesX ) * tilesY,0u )
+{}
+
+void FastClear::Clear( Color c )
+{
+	clearColor = c;
+	pending = true;
+	pendingTiles = tilesX * tilesY;
+	std::fill( masks.begin(),masks.end(),uint64_t( 0u ) );
+	std::fill( tilePending.begin(),tilePending.end(),(unsigned char)1u );
+}
+
+void FastClear::ResolveTile( Surface& surface,unsigned int tx,unsigned int ty )
+{
+	const size_t tile = size_t( ty ) * tilesX + tx;
+	if( !pending || !tilePending[tile] )
+	{
+		return;
+	}
+	const unsigned int left = tx * TileSize;
+	const unsigned int count = std::min( left + TileSize,width ) - left;
+	const unsigned int top = ty * TileSize;
+	const unsigned int bottom = std::min( top + TileSize,height );
+	Color* const pBuffer = surface.GetBufferPtr();
+	const unsigned int pitch = surface.GetPitch();
+	for( unsigned int y = top; y < bottom; y++ )
+	{
+		FillTileRow( pBuffer + size_t( y ) * pitch + left,masks[size_t( y ) * tilesX + tx],count );
+	}
+	tilePending[tile] = 0u;
+	// once every tile is filled in, the rest of the frame skips the masks altogether
+	pendingTiles--;
+	pending = pendingTiles != 0u;
+}
+
+void FastClear::Resolve( Surface& surface )
+{
+	if( !pending )
+	{
+		return;
+	}
+	Color* const pBuffer = surface.GetBufferPtr();
+	const unsigned int pitch = surface.GetPitch();
+	for( unsigned int y = 0u; y < height; y++ )
+	{
+		const unsigned char* const pTiles = &tilePending[size_t( y / TileSize ) * tilesX];
+		const uint64_t* const pMasks = &masks[size_t( y ) * tilesX];
+		Color* const pRow = pBuffer + size_t( y ) * pitch;
+		// untouched pixels of neighbouring tiles are filled as one run
+		unsigned int runStart = 0u;
+		unsigned int runEnd = 0u;
+		for( unsigned int tx = 0u; tx < tilesX; tx++ )
+		{
+			const unsigned int left = tx * TileSize;
+			const unsigned int count = std::min( left + TileSize,width ) - left;
+			if( pTiles[tx] && pMasks[tx] == 0u )
+			{
+				if( runEnd != left )
+				{
+					runStart = left;
+				}
+				runEnd = left + count;
+				continue;
+			}
+			std::fill( pRow + runStart,pRow + runEnd,clearColor );
+			runStart = runEnd = 0u;
+			if( pTiles[tx] )
+			{
+				FillTileRow( pRow + left,pMasks[tx],count );
+			}
+		}
+		std::fill( pRow + runStart,pRow + runEnd,clearColor );
+	}
+	pending = false;
+	pendingTiles = 0u;
+}
+
+void FastClear::FillTileRow( Color* pRow,uint64_t written,unsigned int count ) const
+{
+	// bits of the pixels that exist in this tile row
+	const uint64_t full = count == 64u ? ~uint64_t( 0u ) : (uint64_t( 1u ) << count) - 1u;
+	written &= full;
+	if( written == full )
+	{
+		// row completely overwritten, the clear costs nothing
+		return;
+	}
+	for( unsigned int i = 0u; i < count; i++ )
+	{
+		if( !((written >> i) & 1u) )
+		{
+			pRow[i] = clearColor;
+		}
+	}
+}
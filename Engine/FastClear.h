@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Surface.h"
+#include <vector>
+#include <cstdint>
+
+// deferred clear for a render target
+// Clear() only records the color and flags every tile, pixels written after that are
+// tracked in one bit mask word per tile row, and Resolve() fills in the clear color
+// for just the pixels nobody wrote, so a frame that overwrites everything clears for free
+class FastClear
+{
+public:
+	// edge length of a tile in pixels (one mask word per tile row)
+	// same as Pipeline's binning tiles, so binned workers never share a mask word
+	static constexpr unsigned int TileSize = 64u;
+public:
+	FastClear( unsigned int width,unsigned int height );
+	// only resets the masks, the surface is not touched until Resolve
+	void Clear( Color c );
+	// record that (x,y) was written since the last Clear
+	// (unconditional, the masks only mean something while the clear is pending)
+	void MarkWritten( unsigned int x,unsigned int y )
+	{
+		masks[y * tilesX + x / TileSize] |= uint64_t( 1u ) << (x % TileSize);
+	}
+	// true if (x,y) should read as the clear color instead of the surface contents
+	bool IsCleared( unsigned int x,unsigned int y ) const
+	{
+		return pending && tilePending[(y / TileSize) * tilesX + x / TileSize] &&
+			!((masks[y * tilesX + x / TileSize] >> (x % TileSize)) & 1u);
+	}
+	Color GetClearColor() const
+	{
+		return clearColor;
+	}
+	// fill the unwritten pixels of one tile now (before reading from it)
+	void ResolveTile( Surface& surface,unsigned int tx,unsigned int ty );
+	// fill the unwritten pixels of the tiles overlapping [left,right) x [top,bottom)
+	// (before reading from them, e.g. to blend)
+	// (inline, it is called for every anti-aliased line and mostly finds its tiles resolved already)
+	void ResolveRect( Surface& surface,unsigned int left,unsigned int top,unsigned int right,unsigned int bottom )
+	{
+		if( !pending || left >= right || top >= bottom )
+		{
+			return;
+		}
+		for( unsigned int ty = top / TileSize; ty <= (bottom - 1u) / TileSize; ty++ )
+		{
+			const unsigned char* const pTiles = &tilePending[size_t( ty ) * tilesX];
+			for( unsigned int tx = left / TileSize; tx <= (right - 1u) / TileSize; tx++ )
+			{
+				if( pTiles[tx] )
+				{
+					ResolveTile( surface,tx,ty );
+				}
+			}
+		}
+	}
+	// fill the unwritten pixels of every tile (before presenting)
+	void Resolve( Surface& surface );
+private:
+	void FillTileRow( Color* pRow,uint64_t written,unsigned int count ) const;
+private:
+	unsigned int width;
+	unsigned int height;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	Color clearColor;
+	// any tile waiting for its clear
+	bool pending = false;
+	unsigned int pendingTiles = 0u;
+	std::vector<uint64_t> masks;
+	std::vector<unsigned char> tilePending;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// monotonic counter one thread advances and others wait on (like a d3d12 fence)
+// the producer signals the number of the last piece of work it finished,
+// a consumer waits until the value has reached the work it depends on
+class Fence
+{
+public:
+	Fence() = default;
+	Fence( const Fence& ) = delete;
+	Fence& operator=( const Fence& ) = delete;
+	// values never go back, signaling a smaller value does nothing
+	void Signal( uint64_t value )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			if( value <= completed )
+			{
+				return;
+			}
+			completed = value;
+		}
+		cv.notify_all();
+	}
+	void Wait( uint64_t value ) const
+	{
+		std::unique_lock<std::mutex> lock( mtx );
+		cv.wait( lock,[this,value]() { return completed >= value; } );
+	}
+	uint64_t GetCompletedValue() const
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		return completed;
+	}
+private:
+	mutable std::mutex mtx;
+	mutable std::condition_variable cv;
+	uint64_t completed = 0u;
+};
@@ -0,0 +1,206 @@
+#include "FrameCapture.h"
+#include "ImageEncoder.h"
+#include <sstream>
+#include <iomanip>
+#include <assert.h>
+
+namespace
+{
+	void OpenOutput( std::ofstream& file,const std::wstring& name )
+	{
+#ifdef _WIN32
+		file.open( name,std::ios::binary | std::ios::trunc );
+#else
+		// (wide names only open on msvc, elsewhere they are expected to be ascii)
+		file.open( std::string( name.begin(),name.end() ),std::ios::binary | std::ios::trunc );
+#endif
+	}
+}
+
+FrameCapture::FrameCapture( const std::wstring& path,Format format,unsigned int width,unsigned int height,
+	unsigned int nBuffers,unsigned int framesPerSecond )
+	:
+	path( path ),
+	format( format ),
+	width( width ),
+	height( height ),
+	nSubmitted( 0u ),
+	nWritten( 0u ),
+	nDropped( 0u )
+{
+	if( width == 0u || height == 0u || nBuffers == 0u )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Frame capture needs a frame size and at least one buffer." );
+	}
+	ring.reserve( nBuffers );
+	for( unsigned int i = 0u; i < nBuffers; i++ )
+	{
+		ring.emplace_back( width,height );
+	}
+	if( format == Format::Y4m )
+	{
+		OpenOutput( stream,path );
+		stream << "YUV4MPEG2 W" << width << " H" << height << " F" << framesPerSecond << ":1 Ip A1:1 C420jpeg\n";
+		if( !stream )
+		{
+			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Capturing frames to [" + path + L"]: failed to open." );
+		}
+	}
+	writer = std::thread( &FrameCapture::WriterLoop,this );
+}
+
+FrameCapture::~FrameCapture()
+{
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		quitting = true;
+	}
+	cvQueued.notify_one();
+	writer.join();
+}
+
+bool FrameCapture::Submit( const Surface& frame )
+{
+	assert( frame.GetWidth() == width );
+	assert( frame.GetHeight() == height );
+	nSubmitted++;
+	size_t slot;
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		if( error )
+		{
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception( e );
+		}
+		if( nQueued == ring.size() )
+		{
+			nDropped++;
+			return false;
+		}
+		slot = (first + nQueued) % ring.size();
+	}
+	// the writer cannot see the slot until it is queued, so the copy runs unlocked
+	ring[slot].Copy( frame );
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		nQueued++;
+	}
+	cvQueued.notify_one();
+	return true;
+}
+
+void FrameCapture::Flush()
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	cvWritten.wait( lock,[this]() { return nQueued == 0u; } );
+	if( error )
+	{
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception( e );
+	}
+}
+
+size_t FrameCapture::GetSubmittedCount() const
+{
+	return nSubmitted;
+}
+
+size_t FrameCapture::GetWrittenCount() const
+{
+	return nWritten;
+}
+
+size_t FrameCapture::GetDroppedCount() const
+{
+	return nDropped;
+}
+
+void FrameCapture::WriterLoop()
+{
+	// after a write error the remaining frames are dropped
+	bool failed = false;
+	std::unique_lock<std::mutex> lock( mtx );
+	while( true )
+	{
+		cvQueued.wait( lock,[this]() { return nQueued > 0u || quitting; } );
+		if( nQueued == 0u )
+		{
+			return;
+		}
+		const Surface& frame = ring[first];
+		lock.unlock();
+		std::exception_ptr frameError;
+		if( failed )
+		{
+			nDropped++;
+		}
+		else
+		{
+			try
+			{
+				WriteFrame( frame );
+				nWritten++;
+			}
+			catch( ... )
+			{
+				frameError = std::current_exception();
+				failed = true;
+				nDropped++;
+			}
+		}
+		lock.lock();
+		if( frameError )
+		{
+			error = frameError;
+		}
+		first = (first + 1u) % ring.size();
+		nQueued--;
+		cvWritten.notify_all();
+	}
+}
+
+void FrameCapture::WriteFrame( const Surface& frame )
+{
+	switch( format )
+	{
+	case Format::Y4m:
+		ImageEncoder::EncodeYuv420( frame.GetBufferPtrConst(),frame.GetPitch(),width,height,encoded );
+		stream << "FRAME\n";
+		stream.write( reinterpret_cast<const char*>( encoded.data() ),std::streamsize( encoded.size() ) );
+		stream.flush();
+		if( !stream )
+		{
+			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Capturing frames to [" + path + L"]: failed to write." );
+		}
+		break;
+	default:
+	{
+		if( format == Format::Png )
+		{
+			ImageEncoder::EncodePng( frame.GetBufferPtrConst(),frame.GetPitch(),width,height,encoded );
+		}
+		else
+		{
+			ImageEncoder::EncodePpm( frame.GetBufferPtrConst(),frame.GetPitch(),width,height,encoded );
+		}
+		const std::wstring name = GetFrameName( nWritten );
+		std::ofstream file;
+		OpenOutput( file,name );
+		file.write( reinterpret_cast<const char*>( encoded.data() ),std::streamsize( encoded.size() ) );
+		if( !file )
+		{
+			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Capturing frame to [" + name + L"]: failed to write." );
+		}
+		break;
+	}
+	}
+}
+
+std::wstring FrameCapture::GetFrameName( size_t index ) const
+{
+	std::wstringstream ss;
+	ss << path << std::setw( 6 ) << std::setfill( L'0' ) << index << (format == Format::Png ? L".png" : L".ppm");
+	return ss.str();
+}
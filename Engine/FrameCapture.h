@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Surface.h"
+#include "ChiliException.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <fstream>
+
+// records finished frames without stalling the render thread
+// Submit copies a frame into one of a fixed ring of surfaces and a background thread
+// encodes and writes it, if the writer falls behind and the ring is full the frame is dropped
+class FrameCapture
+{
+public:
+	class Exception : public ChiliException
+	{
+	public:
+		using ChiliException::ChiliException;
+		virtual std::wstring GetFullMessage() const override { return GetNote() + L"\nAt: " + GetLocation(); }
+		virtual std::wstring GetExceptionType() const override { return L"Frame Capture Exception"; }
+	};
+	enum class Format
+	{
+		// one numbered file per frame (path is the name prefix, e.g. L"capture" -> capture000000.png)
+		Png,
+		Ppm,
+		// one raw 4:2:0 video stream (path is the file name)
+		Y4m
+	};
+public:
+	// nBuffers frames can wait for the writer before frames start being dropped
+	FrameCapture( const std::wstring& path,Format format,unsigned int width,unsigned int height,
+		unsigned int nBuffers = 8u,unsigned int framesPerSecond = 60u );
+	FrameCapture( const FrameCapture& ) = delete;
+	FrameCapture& operator=( const FrameCapture& ) = delete;
+	// writes the frames still queued, then stops the writer
+	~FrameCapture();
+	// call from one thread only, never waits on the writer
+	// false if the frame was dropped (rethrows the writer's error if writing failed)
+	bool Submit( const Surface& frame );
+	// waits until every queued frame is written (rethrows the writer's error if writing failed)
+	void Flush();
+	size_t GetSubmittedCount() const;
+	size_t GetWrittenCount() const;
+	size_t GetDroppedCount() const;
+private:
+	void WriterLoop();
+	void WriteFrame( const Surface& frame );
+	std::wstring GetFrameName( size_t index ) const;
+private:
+	std::wstring path;
+	Format format;
+	unsigned int width;
+	unsigned int height;
+	// frames in flight are ring[first] .. ring[first + nQueued - 1] (wrapping)
+	std::vector<Surface> ring;
+	size_t first = 0u;
+	size_t nQueued = 0u;
+	std::mutex mtx;
+	std::condition_variable cvQueued;
+	std::condition_variable cvWritten;
+	std::thread writer;
+	bool quitting = false;
+	std::exception_ptr error;
+	std::atomic<size_t> nSubmitted;
+	std::atomic<size_t> nWritten;
+	std::atomic<size_t> nDropped;
+	// writer thread only
+	std::ofstream stream;
+	std::vector<unsigned char> encoded;
+};
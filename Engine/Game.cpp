@@ -2,14 +2,10 @@
 #include "Game.h"
 
 #include "Geometry.h"
+#include "Cube.h"
 
 using std::vector;
 
-bool is_in_window(const Vec2i & v)
-{
-	return !(v.x < 0 || v.x >= Graphics::ScreenWidth || v.y < 0 || v.y >= Graphics::ScreenHeight);
-}
-
 class ScreenTransformer
 {
 public:
@@ -59,18 +55,29 @@ public:
 		return pRaster;
 	}
 
+	// camera space point (in front of the camera) to raster position, left as float
+	// so lines going off screen are clipped by the rasterizer instead of wrapping around
+	Vec2 Project(
+		const Vec3f &pCamera,
+		const float &canvasWidth,
+		const float &canvasHeight,
+		const uint32_t &imageWidth,
+		const uint32_t &imageHeight
+	) const
+	{
+		const float screenX = pCamera.x / -pCamera.z;
+		const float screenY = pCamera.y / -pCamera.z;
+		const float ndcX = (screenX + canvasWidth * 0.5f) / canvasWidth;
+		const float ndcY = (screenY + canvasHeight * 0.5f) / canvasHeight;
+		return Vec2(ndcX * imageWidth, (1 - ndcY) * imageHeight);
+	}
+
 
 private:
 	double dx;
 	double dy;
 };
 
-struct TIndexedLineList
-{
-	vector<Vec3f> points;
-	vector<unsigned> indices;
-};
-
 class Camera
 {
 public:
@@ -130,30 +137,31 @@ public:
 	}
 };
 
+// vertex of the cube mesh the wireframe edges are built from
+class WireVertex
+{
+public:
+	Vec3 pos;
+};
+
+const float cubeSize = 20.0f;
+
 class CCube
 {
 public:
-	CCube(double size)
+	// the points are the vertices of the wireframe mesh, in the same order
+	CCube(const IndexedTriangleList<WireVertex> & mesh)
 		:
 		scale (1,1,1),
 		rotation(0,0,0),
 		translation (0,0,0)
 	{
-		float x = size / 2;
-		points =
-		{
-			{ -x, +x, +x },
-			{ +x, +x, +x },
-			{ +x, +x, -x },
-			{ -x, +x, -x },
-			{ -x, -x, +x },
-			{ +x, -x, +x },
-			{ +x, -x, -x },
-			{ -x, -x, -x }
-		};
+		for (const auto & v : mesh.GetVertices())
+			points.emplace_back(v.pos.x, v.pos.y, v.pos.z);
 	}
 
-	TIndexedLineList GetLines(void) const
+	// points rotated, scaled and moved to world space
+	vector<Vec3f> GetPoints(void) const
 	{
 		vector<Vec3f> res = points;
 		
@@ -203,10 +211,7 @@ public:
 			i.z += translation.z;
 		}
 
-		return{
-			res,
-			{ 4,5,6, 4,7,6, 3,2,6, 3,7,6, 0,3,7, 0,4,7, 0,1,5, 0,4,5, 1,2,6, 1,5,6, 0,1,2, 0,3,2 }
-		};
+		return res;
 	}
 
 	void Scale(const Vec3f & s)
@@ -258,6 +263,35 @@ void computePixelCoordinates(
 
 float canvasWidth = 2, canvasHeight = 2;
 uint32_t imageWidth = Graphics::ScreenWidth, imageHeight = Graphics::ScreenHeight;
+// distance in front of the camera where lines are cut (camera looks down -z)
+const float nearZ = 0.1f;
+
+// cuts off the part of a camera space line that is behind the near plane,
+// false if nothing is left
+bool clipNear(Vec3f & p0, Vec3f & p1)
+{
+	const bool in0 = p0.z <= -nearZ;
+	const bool in1 = p1.z <= -nearZ;
+	if (!in0 && !in1)
+		return false;
+	if (!in0)
+		p0 = p0 + (p1 - p0) * ((-nearZ - p0.z) / (p1.z - p0.z));
+	else if (!in1)
+		p1 = p1 + (p0 - p1) * ((-nearZ - p1.z) / (p0.z - p1.z));
+	return true;
+}
+
+// adds the visible part of a camera space line to the batch
+void addLine(vector<Graphics::LineSegment> & lines, const ScreenTransformer & transformer, Vec3f p0, Vec3f p1, Color c)
+{
+	if (clipNear(p0, p1))
+	{
+		lines.push_back({
+			transformer.Project(p0, canvasWidth, canvasHeight, imageWidth, imageHeight),
+			transformer.Project(p1, canvasWidth, canvasHeight, imageWidth, imageHeight),
+			c });
+	}
+}
 
 const Vec3f verts[146] = {
 	{ 0,    39.034,         0 },{ 0.76212,    36.843,         0 },
@@ -396,8 +430,10 @@ vector<vector<vector<CCube>>> chunk;
 Game::Game( MainWindow& wnd )
 	:
 	wnd( wnd ),
-	gfx( wnd )
+	gfx( wnd ),
+	cubeEdges( Cube::GetPlain<WireVertex>( cubeSize ),EdgeList::Filter::Feature )
 {
+	const auto cubeMesh = Cube::GetPlain<WireVertex>( cubeSize );
 	for (int i = 0; i < 100; ++i)
 	{
 		vector<vector<CCube>> tmp1;
@@ -406,7 +442,7 @@ Game::Game( MainWindow& wnd )
 			vector<CCube> tmp;
 			for (int k = 0; k < 100; ++k)
 			{
-				tmp.push_back(CCube(20));
+				tmp.push_back(CCube(cubeMesh));
 				tmp.back().translation = Vec3f(-500 + i * 20,0 + j * 20, -500 + k * 20);
 			}
 			tmp1.push_back(tmp);
@@ -419,6 +455,24 @@ void Game::Go()
 {
 	if (wnd.kbd.KeyIsPressed(VK_ESCAPE))
 		wnd.Kill();
+	// F9 toggles recording, F8 switches between drawing every edge of the cubes and only their outlines,
+	// F7 turns anti-aliasing of the lines on and off
+	while( !wnd.kbd.KeyIsEmpty() )
+	{
+		const Keyboard::Event e = wnd.kbd.ReadKey();
+		if( e.IsPress() && e.GetCode() == VK_F9 )
+		{
+			ToggleCapture();
+		}
+		else if( e.IsPress() && e.GetCode() == VK_F8 )
+		{
+			silhouetteOnly = !silhouetteOnly;
+		}
+		else if( e.IsPress() && e.GetCode() == VK_F7 )
+		{
+			antiAliased = !antiAliased;
+		}
+	}
 
 	gfx.BeginFrame();
 	UpdateModel();
@@ -426,6 +480,22 @@ void Game::Go()
 	gfx.EndFrame();
 }
 
+void Game::ToggleCapture()
+{
+	if( pCapture )
+	{
+		// the destructor writes what is still queued
+		gfx.SetCapture( nullptr );
+		pCapture.reset();
+	}
+	else
+	{
+		pCapture = std::make_unique<FrameCapture>( L"capture.y4m",FrameCapture::Format::Y4m,
+			Graphics::ScreenWidth,Graphics::ScreenHeight );
+		gfx.SetCapture( pCapture.get() );
+	}
+}
+
 Camera c(Vec3f(50, 50, 50), Vec3f(150, 1, 1));
 
 void Game::UpdateModel()
@@ -539,6 +609,9 @@ void Game::ComposeFrame()
 	Matrix44f worldToCamera = cameraToWorld.inverse();
 
 	ScreenTransformer transformer;
+	// the whole wireframe goes to the rasterizer in one batch
+	lines.clear();
+	cameraPoints.resize(cubeEdges.GetVertexCount());
 
 	//for (unsigned i = 0; i < numTris; ++i)
 	//{
@@ -561,30 +634,38 @@ void Game::ComposeFrame()
 		{
 			for (const auto & it3 : it2)
 			{
-				TIndexedLineList list = it3.GetLines();
-				for (unsigned i = 0; i < list.indices.size() - 1; i += 3)
+				// every corner is transformed once, then each edge is drawn once
+				// (edges with an end off screen or behind the camera are clipped, not dropped)
+				const vector<Vec3f> points = it3.GetPoints();
+				for (size_t i = 0; i < points.size(); ++i)
+				{
+					worldToCamera.multVecMatrix(points[i], cameraPoints[i]);
+				}
+				const auto & edges = cubeEdges.GetEdges();
+				if (silhouetteOnly)
+				{
+					cubeEdges.GetSilhouette(points.data(), c.pos, edgeIndices);
+				}
+				const size_t nEdges = silhouetteOnly ? edgeIndices.size() : edges.size();
+				for (size_t i = 0; i < nEdges; ++i)
 				{
-					const Vec3f point1 = list.points[list.indices[i]];
-					const Vec3f point2 = list.points[list.indices[i + 1]];
-					const Vec3f point3 = list.points[list.indices[i + 2]];
-					Vec2i res1 = transformer.Transform(point1, worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-					Vec2i res2 = transformer.Transform(point2, worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-					Vec2i res3 = transformer.Transform(point3, worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-
-					if (is_in_window(res1) && is_in_window(res2))
-						gfx.DrawLine_s(res1.x, res1.y, res2.x, res2.y, Colors::Gray);
-					if (is_in_window(res2) && is_in_window(res3))
-						gfx.DrawLine_s(res2.x, res2.y, res3.x, res3.y, Colors::Gray);
+					const EdgeList::Edge & e = edges[silhouetteOnly ? edgeIndices[i] : i];
+					addLine(lines, transformer, cameraPoints[e.v0], cameraPoints[e.v1], Colors::Gray);
 				}
 			}
 		}
 	}
 	//draw axes:
-	Vec2i op = transformer.Transform(Vec3f(0, 0, 0), worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-	Vec2i x_axis = transformer.Transform(Vec3f(100, 0, 0), worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-	Vec2i y_axis = transformer.Transform(Vec3f(0, 100, 0), worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-	Vec2i z_axis = transformer.Transform(Vec3f(0, 0, 100), worldToCamera, canvasWidth, canvasHeight, imageWidth, imageHeight);
-	gfx.DrawLine_s(op.x, op.y, x_axis.x, x_axis.y, Colors::MakeRGB(125, 0, 0));
-	gfx.DrawLine_s(op.x, op.y, y_axis.x, y_axis.y, Colors::MakeRGB(0, 125, 0));
-	gfx.DrawLine_s(op.x, op.y, z_axis.x, z_axis.y, Colors::MakeRGB(0, 0, 125));
+	Vec3f op, x_axis, y_axis, z_axis;
+	worldToCamera.multVecMatrix(Vec3f(0, 0, 0), op);
+	worldToCamera.multVecMatrix(Vec3f(100, 0, 0), x_axis);
+	worldToCamera.multVecMatrix(Vec3f(0, 100, 0), y_axis);
+	worldToCamera.multVecMatrix(Vec3f(0, 0, 100), z_axis);
+	addLine(lines, transformer, op, x_axis, Colors::MakeRGB(125, 0, 0));
+	addLine(lines, transformer, op, y_axis, Colors::MakeRGB(0, 125, 0));
+	addLine(lines, transformer, op, z_axis, Colors::MakeRGB(0, 0, 125));
+	if (antiAliased)
+		gfx.DrawLinesAA(lines);
+	else
+		gfx.DrawLines(lines);
 }
\ No newline at end of file
@@ -25,6 +25,9 @@
 #include <vector>
 #include "Scene.h"
 #include "FrameTimer.h"
+#include "FrameCapture.h"
+#include "EdgeList.h"
+#include "Geometry.h"
 
 class Game
 {
@@ -41,6 +44,8 @@ private:
 	void CycleScenes();
 	void ReverseCycleScenes();
 	void OutputSceneName() const;
+	// starts / stops recording the frames to capture.y4m
+	void ToggleCapture();
 	/********************************/
 private:
 	MainWindow& wnd;
@@ -50,5 +55,17 @@ private:
 	FrameTimer ft;
 	std::vector<std::unique_ptr<Scene>> scenes;
 	std::vector<std::unique_ptr<Scene>>::iterator curScene;
+	std::unique_ptr<FrameCapture> pCapture;
+	// line batch of the frame (kept to reuse its capacity)
+	std::vector<Graphics::LineSegment> lines;
+	// unique edges of the cube mesh, shared by all the cubes
+	EdgeList cubeEdges;
+	// draw only the outlines of the cubes as seen from the camera (F8)
+	bool silhouetteOnly = false;
+	std::vector<uint32_t> edgeIndices;
+	// corners of the cube being drawn in camera space
+	std::vector<Vec3f> cameraPoints;
+	// smooth lines (F7), off by default since they cost about 40% more than the plain ones
+	bool antiAliased = false;
 	/********************************/
 };
\ No newline at end of file
@@ -18,14 +18,20 @@
 *	You should have received a copy of the GNU General Public License					  *
 *	along with The Chili DirectX Framework.  If not, see <http://www.gnu.org/licenses/>.  *
 ******************************************************************************************/
-#include "MainWindow.h"
 #include "Graphics.h"
-#include "DXErr.h"
+#include "FrameCapture.h"
 #include "ChiliException.h"
 #include <assert.h>
 #include <string>
 #include <array>
 #include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#ifndef CHILI_HEADLESS
+#include "MainWindow.h"
+#include "DXErr.h"
 
 // Ignore the intellisense error "cannot open source file" for .shh files.
 // They will be created during the build sequence before the preprocessor runs.
@@ -38,12 +44,28 @@ namespace FramebufferShaders
 #pragma comment( lib,"d3d11.lib" )
 
 using Microsoft::WRL::ComPtr;
+#endif
 
-Graphics::Graphics( HWNDKey& key )
+// (the sizes are passed by reference to emplace_back)
+constexpr unsigned int Graphics::ScreenWidth;
+constexpr unsigned int Graphics::ScreenHeight;
+
+#ifndef CHILI_HEADLESS
+Graphics::Graphics( HWNDKey& key,unsigned int maxFramesInFlight )
 	:
-	sysBuffer( ScreenWidth,ScreenHeight )
+	quitting( false ),
+	presentFailed( false ),
+	maxFramesInFlight( maxFramesInFlight ),
+	fastClear( ScreenWidth,ScreenHeight )
 {
 	assert( key.hWnd != nullptr );
+	// one buffer to draw into plus one per frame in flight
+	sysBuffers.reserve( maxFramesInFlight + 1u );
+	for( unsigned int i = 0u; i <= maxFramesInFlight; i++ )
+	{
+		sysBuffers.emplace_back( ScreenWidth,ScreenHeight,Surface::Allocation::HugePages );
+	}
+	pSysBuffer = &sysBuffers.front();
 
 	//////////////////////////////////////////////////////
 	// create device and swap chain/get render target view
@@ -238,17 +260,77 @@ Graphics::Graphics( HWNDKey& key )
 	{
 		throw CHILI_GFX_EXCEPTION( hr,L"Creating sampler state" );
 	}
+
+	// from here on only the presentation thread uses the device context
+	presenter = std::thread( &Graphics::PresentLoop,this );
 }
 
 Graphics::~Graphics()
 {
+	// frames still waiting are not presented
+	if( presenter.joinable() )
+	{
+		quitting = true;
+		frameSubmitted.Signal( UINT64_MAX );
+		presenter.join();
+	}
 	// clear the state of the device context before destruction
 	if( pImmediateContext ) pImmediateContext->ClearState();
 }
 
 void Graphics::EndFrame()
+{
+	// apply the frame's clear to whatever was not drawn
+	fastClear.Resolve( *pSysBuffer );
+	// the capture copies the frame and encodes it on its own thread
+	if( pCapture )
+	{
+		pCapture->Submit( *pSysBuffer );
+	}
+
+	// hand the frame to the presentation thread
+	frameIndex++;
+	frameSubmitted.Signal( frameIndex );
+	// at most maxFramesInFlight frames may wait for presentation while the next one is drawn
+	// (which also means the buffer it reuses, from maxFramesInFlight + 1 frames back, is free)
+	if( frameIndex > maxFramesInFlight )
+	{
+		framePresented.Wait( frameIndex - maxFramesInFlight );
+	}
+	if( presentFailed )
+	{
+		std::rethrow_exception( presentError );
+	}
+	pSysBuffer = &sysBuffers[frameIndex % sysBuffers.size()];
+}
+
+void Graphics::PresentLoop()
+{
+	try
+	{
+		for( uint64_t frame = 1u; ; frame++ )
+		{
+			frameSubmitted.Wait( frame );
+			if( quitting )
+			{
+				return;
+			}
+			PresentFrame( frame );
+		}
+	}
+	catch( ... )
+	{
+		// the render thread rethrows it at the end of its frame
+		presentError = std::current_exception();
+		presentFailed = true;
+		framePresented.Signal( UINT64_MAX );
+	}
+}
+
+void Graphics::PresentFrame( uint64_t frame )
 {
 	HRESULT hr;
+	const Surface& buffer = sysBuffers[(frame - 1u) % sysBuffers.size()];
 
 	// lock and map the adapter memory for copying over the sysbuffer
 	if( FAILED( hr = pImmediateContext->Map( pSysBufferTexture.Get(),0u,
@@ -257,7 +339,7 @@ void Graphics::EndFrame()
 		throw CHILI_GFX_EXCEPTION( hr,L"Mapping sysbuffer" );
 	}
 	// perform the copy line-by-line
-	sysBuffer.Present( mappedSysBufferTexture.RowPitch,
+	buffer.Present( mappedSysBufferTexture.RowPitch,
 		reinterpret_cast<BYTE*>(mappedSysBufferTexture.pData) );
 	// release the adapter memory
 	pImmediateContext->Unmap( pSysBufferTexture.Get(),0u );
@@ -279,14 +361,54 @@ void Graphics::EndFrame()
 	{
 		throw CHILI_GFX_EXCEPTION( hr,L"Presenting back buffer" );
 	}
+	framePresented.Signal( frame );
+}
+
+#else
+Graphics::Graphics()
+	:
+	fastClear( ScreenWidth,ScreenHeight )
+{
+	sysBuffers.emplace_back( ScreenWidth,ScreenHeight,Surface::Allocation::HugePages );
+	pSysBuffer = &sysBuffers.front();
+	fastClear.Clear( Colors::Red );
+}
+
+Graphics::~Graphics() = default;
+
+void Graphics::EndFrame()
+{
+	// nothing to present, the frame stays in the sysbuffer until the next one is drawn
+	fastClear.Resolve( *pSysBuffer );
+	if( pCapture )
+	{
+		pCapture->Submit( *pSysBuffer );
+	}
+	frameIndex++;
+}
+#endif
+
+void Graphics::DrawSprite( int x,int y,const Surface& sprite,AlphaBlend::Mode mode )
+{
+	const int left = std::max( x,0 );
+	const int top = std::max( y,0 );
+	const int right = std::min( x + int( sprite.GetWidth() ),int( ScreenWidth ) );
+	const int bottom = std::min( y + int( sprite.GetHeight() ),int( ScreenHeight ) );
+	if( left >= right || top >= bottom )
+	{
+		return;
+	}
+	fastClear.ResolveRect( *pSysBuffer,(unsigned int)left,(unsigned int)top,(unsigned int)right,(unsigned int)bottom );
+	pSysBuffer->Blend( x,y,sprite,mode );
 }
 
 void Graphics::BeginFrame()
 {
-	sysBuffer.Clear( Colors::Red );
+	fastClear.Clear( Colors::Red );
 }
 
 
+#ifndef CHILI_HEADLESS
 //////////////////////////////////////////////////
 //           Graphics Exception
 Graphics::Exception::Exception( HRESULT hr,const std::wstring& note,const wchar_t* file,unsigned int line )
@@ -329,108 +451,257 @@ std::wstring Graphics::Exception::GetExceptionType() const
 	return L"Chili Graphics Exception";
 }
 
+#endif
+
 void Graphics::DrawLine( float x1,float y1,float x2,float y2,Color c )
 {
-	const float dx = x2 - x1;
-	const float dy = y2 - y1;
+	DrawLineUnchecked( int( x1 ),int( y1 ),int( x2 ),int( y2 ),c );
+}
 
-	if( dy == 0.0f && dx == 0.0f )
+void Graphics::DrawLine_s( float x1,float y1,float x2,float y2,Color c )
+{
+	if( ClipLine( x1,y1,x2,y2 ) )
 	{
-		PutPixel( int( x1 ),int( y1 ),c );
+		DrawLineUnchecked( int( x1 ),int( y1 ),int( x2 ),int( y2 ),c );
 	}
-	else if( abs( dy ) > abs( dx ) )
-	{
-		if( dy < 0.0f )
-		{
-			std::swap( x1,x2 );
-			std::swap( y1,y2 );
-		}
+}
 
-		const float m = dx / dy;
-		float y = y1;
-		int lastIntY;
-		for( float x = x1; y < y2; y += 1.0f,x += m )
-		{
-			lastIntY = int( y );
-			PutPixel( int( x ),lastIntY,c );
-		}
-		if( int( y2 ) > lastIntY )
+void Graphics::DrawLines( const LineSegment* pLines,size_t count )
+{
+	for( const LineSegment* pEnd = pLines + count; pLines != pEnd; pLines++ )
+	{
+		float x1 = pLines->p0.x;
+		float y1 = pLines->p0.y;
+		float x2 = pLines->p1.x;
+		float y2 = pLines->p1.y;
+		if( ClipLine( x1,y1,x2,y2 ) )
 		{
-			PutPixel( int( x2 ),int( y2 ),c );
+			DrawLineUnchecked( int( x1 ),int( y1 ),int( x2 ),int( y2 ),pLines->c );
 		}
 	}
-	else
+}
+
+void Graphics::DrawLineAA( float x1,float y1,float x2,float y2,Color c )
+{
+	if( ClipLine( x1,y1,x2,y2 ) )
 	{
-		if( dx < 0.0f )
-		{
-			std::swap( x1,x2 );
-			std::swap( y1,y2 );
-		}
+		ResolveUnderLine( x1,y1,x2,y2 );
+		unsigned int offsets[MaxLinePixels];
+		unsigned char coverage[MaxLinePixels];
+		const size_t count = GatherLineAA( x1,y1,x2,y2,offsets,coverage );
+		AlphaBlend::BlendCoverage( pSysBuffer->GetBufferPtr(),offsets,coverage,count,c );
+	}
+}
 
-		const float m = dy / dx;
-		float x = x1;
-		int lastIntX;
-		for( float y = y1; x < x2; x += 1.0f,y += m )
-		{
-			lastIntX = int( x );
-			PutPixel( lastIntX,int( y ),c );
-		}
-		if( int( x2 ) > lastIntX )
+void Graphics::DrawLinesAA( const LineSegment* pLines,size_t count )
+{
+	// the pixels of consecutive lines of one color are blended together, each line is padded to
+	// whole blocks of 4 (see BlendCoverage) with zero weight copies of a pixel in its last block,
+	// so lines meeting at a pixel never share a block
+	constexpr size_t batchSize = 8u * MaxLinePixels;
+	lineOffsets.resize( batchSize + 4u );
+	lineCoverage.resize( batchSize + 4u );
+	unsigned int* const pOffsets = lineOffsets.data();
+	unsigned char* const pCoverage = lineCoverage.data();
+	size_t nBatched = 0u;
+	Color batchColor;
+	for( const LineSegment* pEnd = pLines + count; pLines != pEnd; pLines++ )
+	{
+		float x1 = pLines->p0.x;
+		float y1 = pLines->p0.y;
+		float x2 = pLines->p1.x;
+		float y2 = pLines->p1.y;
+		if( ClipLine( x1,y1,x2,y2 ) )
 		{
-			PutPixel( int( x2 ),int( y2 ),c );
+			ResolveUnderLine( x1,y1,x2,y2 );
+			if( nBatched + MaxLinePixels > batchSize || pLines->c.dword != batchColor.dword )
+			{
+				AlphaBlend::BlendCoverage( pSysBuffer->GetBufferPtr(),pOffsets,pCoverage,nBatched,batchColor );
+				nBatched = 0u;
+				batchColor = pLines->c;
+			}
+			const size_t n = GatherLineAA( x1,y1,x2,y2,pOffsets + nBatched,pCoverage + nBatched );
+			const size_t lastBlock = nBatched + ((n - 1u) & ~size_t( 3u ));
+			for( nBatched += n; nBatched % 4u != 0u; nBatched++ )
+			{
+				pOffsets[nBatched] = pOffsets[lastBlock];
+				pCoverage[nBatched] = 0u;
+			}
 		}
 	}
+	AlphaBlend::BlendCoverage( pSysBuffer->GetBufferPtr(),pOffsets,pCoverage,nBatched,batchColor );
 }
 
-void Graphics::DrawLine_s(float x1, float y1, float x2, float y2, Color c)
+void Graphics::ResolveUnderLine( float x1,float y1,float x2,float y2 )
 {
-	const float dx = x2 - x1;
-	const float dy = y2 - y1;
+	fastClear.ResolveRect( *pSysBuffer,
+		(unsigned int)( std::max( int( std::min( x1,x2 ) ) - 1,0 ) ),
+		(unsigned int)( std::max( int( std::min( y1,y2 ) ) - 1,0 ) ),
+		std::min( (unsigned int)( std::max( x1,x2 ) ) + 2u,ScreenWidth ),
+		std::min( (unsigned int)( std::max( y1,y2 ) ) + 2u,ScreenHeight ) );
+}
 
-	if (dy == 0.0f && dx == 0.0f)
+bool Graphics::ClipLine( float& x1,float& y1,float& x2,float& y2 )
+{
+	// clipped to pixel coordinates [0,size - 1], so the ends truncate to pixels on screen
+	// (rounding in the clip can overshoot by a hair, which truncation absorbs)
+	const float xMax = float( ScreenWidth - 1u );
+	const float yMax = float( ScreenHeight - 1u );
+	// most lines are entirely on screen
+	if( x1 >= 0.0f && x1 <= xMax && x2 >= 0.0f && x2 <= xMax &&
+		y1 >= 0.0f && y1 <= yMax && y2 >= 0.0f && y2 <= yMax )
 	{
-		PutPixel_s(int(x1), int(y1), c);
+		return true;
 	}
-	else if (abs(dy) > abs(dx))
+	// nan or infinite ends are not drawn (one test for all four)
+	if( !std::isfinite( x1 + y1 + x2 + y2 ) )
+	{
+		return false;
+	}
+	const float dx = x2 - x1;
+	const float dy = y2 - y1;
+	// the line is x1 + t * dx, y1 + t * dy for t in [tEnter,tExit]
+	// each edge is p * t <= q, with p < 0 entering the inside and p > 0 leaving it
+	const float p[4] = { -dx,dx,-dy,dy };
+	const float q[4] = { x1,xMax - x1,y1,yMax - y1 };
+	float tEnter = 0.0f;
+	float tExit = 1.0f;
+	for( int i = 0; i < 4; i++ )
 	{
-		if (dy < 0.0f)
+		if( p[i] == 0.0f )
 		{
-			std::swap(x1, x2);
-			std::swap(y1, y2);
+			// parallel to the edge, either all outside or no limit
+			if( q[i] < 0.0f )
+			{
+				return false;
+			}
 		}
+		else
+		{
+			const float t = q[i] / p[i];
+			if( p[i] < 0.0f )
+			{
+				tEnter = std::max( tEnter,t );
+			}
+			else
+			{
+				tExit = std::min( tExit,t );
+			}
+		}
+	}
+	if( tEnter > tExit )
+	{
+		return false;
+	}
+	x2 = x1 + tExit * dx;
+	y2 = y1 + tExit * dy;
+	x1 = x1 + tEnter * dx;
+	y1 = y1 + tEnter * dy;
+	return true;
+}
 
-		const float m = dx / dy;
-		float y = y1;
-		int lastIntY;
-		for (float x = x1; y < y2; y += 1.0f, x += m)
+void Graphics::DrawLineUnchecked( int x1,int y1,int x2,int y2,Color c )
+{
+	// step along the major axis one pixel at a time,
+	// the error term decides when the minor axis steps too
+	// (the sign of the error is turned into a mask instead of a branch,
+	//  for lines of any slope that branch is a coin flip)
+	const int dx = std::abs( x2 - x1 );
+	const int dy = std::abs( y2 - y1 );
+	if( dx >= dy )
+	{
+		if( x1 > x2 )
 		{
-			lastIntY = int(y);
-			PutPixel_s(int(x), lastIntY, c);
+			std::swap( x1,x2 );
+			std::swap( y1,y2 );
 		}
-		if (int(y2) > lastIntY)
+		const int yStep = y1 < y2 ? 1 : -1;
+		int error = dx / 2;
+		for( int x = x1,y = y1; x <= x2; x++ )
 		{
-			PutPixel_s(int(x2), int(y2), c);
+			PutPixel( x,y,c );
+			error -= dy;
+			const int step = error >> 31;
+			y += yStep & step;
+			error += dx & step;
 		}
 	}
 	else
 	{
-		if (dx < 0.0f)
+		if( y1 > y2 )
 		{
-			std::swap(x1, x2);
-			std::swap(y1, y2);
+			std::swap( x1,x2 );
+			std::swap( y1,y2 );
 		}
-
-		const float m = dy / dx;
-		float x = x1;
-		int lastIntX;
-		for (float y = y1; x < x2; x += 1.0f, y += m)
+		const int xStep = x1 < x2 ? 1 : -1;
+		int error = dy / 2;
+		for( int y = y1,x = x1; y <= y2; y++ )
 		{
-			lastIntX = int(x);
-			PutPixel_s(lastIntX, int(y), c);
+			PutPixel( x,y,c );
+			error -= dx;
+			const int step = error >> 31;
+			x += xStep & step;
+			error += dy & step;
 		}
-		if (int(x2) > lastIntX)
+	}
+}
+
+size_t Graphics::GatherLineAA( float x1,float y1,float x2,float y2,unsigned int* offsets,unsigned char* coverage ) const
+{
+	// step along the major axis one pixel at a time, the minor coordinate is kept in 16.16 fixed point,
+	// its fraction splits the coverage between the two pixels it falls between
+	// pixel centers are on whole coordinates, so a line between whole coordinates along an axis
+	// stays one pixel wide and covers the same pixels as DrawLine
+	// the two end pixels along the major axis are weighted by how much of them the line spans
+	// (a line from center to center covers half of each)
+	const bool steep = std::abs( y2 - y1 ) > std::abs( x2 - x1 );
+	if( steep )
+	{
+		std::swap( x1,y1 );
+		std::swap( x2,y2 );
+	}
+	if( x1 > x2 )
+	{
+		std::swap( x1,x2 );
+		std::swap( y1,y2 );
+	}
+	const int pitch = int( pSysBuffer->GetPitch() );
+	const int majorStride = steep ? pitch : 1;
+	const int minorStride = steep ? 1 : pitch;
+	const int minorSize = int( steep ? ScreenWidth : ScreenHeight );
+	const int start = int( x1 + 0.5f );
+	const int end = int( x2 + 0.5f );
+	const float gradient = x2 > x1 ? (y2 - y1) / (x2 - x1) : 0.0f;
+	const int step = int( std::floor( gradient * 65536.0f + 0.5f ) );
+	int minor = int( std::floor( (y1 + (float( start ) - x1) * gradient) * 65536.0f + 0.5f ) );
+	// a pixel off screen next to the line is dropped by not advancing the count
+	size_t count = 0u;
+	// weight is out of 256 (the whole pixel)
+	const auto Plot = [&]( int major,int weight )
+	{
+		const int m = minor >> 16;
+		const int f = (minor >> 8) & 0xFF;
+		const int offset = major * majorStride + m * minorStride;
+		offsets[count] = (unsigned int)( offset );
+		coverage[count] = (unsigned char)( ((255 - f) * weight) >> 8 );
+		count += m >= 0;
+		offsets[count] = (unsigned int)( offset + minorStride );
+		coverage[count] = (unsigned char)( (f * weight) >> 8 );
+		count += m + 1 < minorSize;
+	};
+	if( start == end )
+	{
+		Plot( start,int( (x2 - x1) * 256.0f + 0.5f ) );
+	}
+	else
+	{
+		Plot( start,int( (float( start ) + 0.5f - x1) * 256.0f + 0.5f ) );
+		minor += step;
+		for( int major = start + 1; major < end; major++,minor += step )
 		{
-			PutPixel_s(int(x2), int(y2), c);
+			Plot( major,256 );
 		}
+		Plot( end,int( (x2 - float( end ) + 0.5f) * 256.0f + 0.5f ) );
 	}
-}
\ No newline at end of file
+	return count;
+}
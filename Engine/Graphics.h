@@ -19,18 +19,33 @@
 *	along with The Chili DirectX Framework.  If not, see <http://www.gnu.org/licenses/>.  *
 ******************************************************************************************/
 #pragma once
+// define CHILI_HEADLESS to build without a window or d3d, frames are only rendered into the
+// sysbuffer (for running scenes on machines without a gpu, see HeadlessMain.cpp)
+#ifndef CHILI_HEADLESS
 #include <d3d11.h>
 #include <wrl.h>
 #include "GDIPlusManager.h"
+#endif
 #include "ChiliException.h"
 #include "Surface.h"
+#include "FastClear.h"
 #include "Colors.h"
 #include "Vec2.h"
+#include "Fence.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
 
+class FrameCapture;
+
+#ifndef CHILI_HEADLESS
 #define CHILI_GFX_EXCEPTION( hr,note ) Graphics::Exception( hr,note,_CRT_WIDE(__FILE__),__LINE__ )
+#endif
 
 class Graphics
 {
+#ifndef CHILI_HEADLESS
 public:
 	class Exception : public ChiliException
 	{
@@ -50,8 +65,25 @@ private:
 		float x,y,z;		// position
 		float u,v;			// texcoords
 	};
+#endif
+public:
+	// line from p0 to p1, both ends drawn
+	class LineSegment
+	{
+	public:
+		Vec2 p0;
+		Vec2 p1;
+		Color c;
+	};
 public:
-	Graphics( class HWNDKey& key );
+#ifndef CHILI_HEADLESS
+	// frames are copied out and presented on a thread of their own while the next one is drawn
+	// maxFramesInFlight finished frames may wait for (or be in) presentation when EndFrame returns,
+	// each needs a sysbuffer of its own (1 is double buffering, 2 triple, 0 presents before returning)
+	Graphics( class HWNDKey& key,unsigned int maxFramesInFlight = 2u );
+#else
+	Graphics();
+#endif
 	Graphics( const Graphics& ) = delete;
 	Graphics& operator=( const Graphics& ) = delete;
 	void EndFrame();
@@ -60,30 +92,93 @@ public:
 	{
 		DrawLine( p1.x,p1.y,p2.x,p2.y,c );
 	}
+	// both ends have to be on screen
 	void DrawLine( float x1,float y1,float x2,float y2,Color c );
-
-	void DrawLine_s(float x1, float y1, float x2, float y2, Color c);
-	void DrawLine_s(const Vec2& p1, const Vec2& p2, Color c)
+	// clipped to the screen first, so the ends can be anywhere (lines off screen cost nothing)
+	void DrawLine_s( float x1,float y1,float x2,float y2,Color c );
+	void DrawLine_s( const Vec2& p1,const Vec2& p2,Color c )
+	{
+		DrawLine_s( p1.x,p1.y,p2.x,p2.y,c );
+	}
+	// DrawLine_s for every segment
+	void DrawLines( const LineSegment* pLines,size_t count );
+	void DrawLines( const std::vector<LineSegment>& lines )
+	{
+		DrawLines( lines.data(),lines.size() );
+	}
+	// anti-aliased (xiaolin wu), clipped like DrawLine_s
+	// the pixels on either side of the line are moved toward c by how much of them it covers,
+	// stepped in fixed point, the end pixels are weighted by how much of them the line spans,
+	// the lazy clear is resolved under each line before it is blended
+	void DrawLineAA( float x1,float y1,float x2,float y2,Color c );
+	void DrawLineAA( const Vec2& p1,const Vec2& p2,Color c )
+	{
+		DrawLineAA( p1.x,p1.y,p2.x,p2.y,c );
+	}
+	// DrawLineAA for every segment (the pixels of consecutive lines of one color are blended together)
+	void DrawLinesAA( const LineSegment* pLines,size_t count );
+	void DrawLinesAA( const std::vector<LineSegment>& lines )
 	{
-		DrawLine_s(p1.x, p1.y, p2.x, p2.y, c);
+		DrawLinesAA( lines.data(),lines.size() );
 	}
 	void PutPixel( int x,int y,int r,int g,int b )
 	{
-		PutPixel( x,y,{ unsigned char( r ),unsigned char( g ),unsigned char( b ) } );
+		PutPixel( x,y,{ (unsigned char)( r ),(unsigned char)( g ),(unsigned char)( b ) } );
 	}
 	void PutPixel( int x,int y,Color c )
 	{
-		sysBuffer.PutPixel( x,y,c );
+		pSysBuffer->PutPixel( x,y,c );
+		fastClear.MarkWritten( x,y );
 	}
 	void PutPixel_s(int x, int y, Color c)
 	{
 		if (x < 0 || y < 0 || x > ScreenWidth - 1 || y > ScreenHeight - 1)
 			return;
-		sysBuffer.PutPixel(x, y, c);
+		PutPixel(x, y, c);
+	}
+	// reads the frame as drawn so far (pixels not drawn yet read as the clear color)
+	Color GetPixel( int x,int y ) const
+	{
+		return fastClear.IsCleared( x,y ) ? fastClear.GetClearColor() : pSysBuffer->GetPixel( x,y );
+	}
+	// blending reads the frame, so the lazy clear is applied to the tiles it touches first
+	void BlendSpan( unsigned int x,unsigned int y,const Color* pSrc,unsigned int count,
+		AlphaBlend::Mode mode = AlphaBlend::Mode::Straight )
+	{
+		fastClear.ResolveRect( *pSysBuffer,x,y,x + count,y + 1u );
+		pSysBuffer->BlendSpan( x,y,pSrc,count,mode );
+	}
+	// blends the sprite with its top left corner at (x,y), clipped to the screen
+	void DrawSprite( int x,int y,const Surface& sprite,AlphaBlend::Mode mode = AlphaBlend::Mode::Straight );
+	// every finished frame is handed to the capture (nullptr stops capturing)
+	void SetCapture( FrameCapture* pCapture_in )
+	{
+		pCapture = pCapture_in;
+	}
+	// the last finished frame (after EndFrame, until its buffer is drawn into again)
+	const Surface& GetFrame() const
+	{
+		return sysBuffers[(frameIndex + sysBuffers.size() - 1u) % sysBuffers.size()];
 	}
 
 	~Graphics();
 private:
+	// cuts the line to the screen rectangle (liang-barsky), false if none of it is on screen
+	static bool ClipLine( float& x1,float& y1,float& x2,float& y2 );
+	// integer bresenham, both ends on screen
+	void DrawLineUnchecked( int x1,int y1,int x2,int y2,Color c );
+	// fills in the lazy clear under a clipped line and the pixels next to it (blending reads them)
+	void ResolveUnderLine( float x1,float y1,float x2,float y2 );
+	// pixels (offsets into the frame) and coverage of a wu line with both ends on screen,
+	// returns how many (the pixels next to it that are off screen are left out)
+	size_t GatherLineAA( float x1,float y1,float x2,float y2,unsigned int* offsets,unsigned char* coverage ) const;
+#ifndef CHILI_HEADLESS
+	void PresentLoop();
+	// copies the frame's buffer to the gpu and flips (presentation thread)
+	void PresentFrame( uint64_t frame );
+#endif
+private:
+#ifndef CHILI_HEADLESS
 	GDIPlusManager										gdipMan;
 	Microsoft::WRL::ComPtr<IDXGISwapChain>				pSwapChain;
 	Microsoft::WRL::ComPtr<ID3D11Device>				pDevice;
@@ -97,8 +192,32 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11InputLayout>			pInputLayout;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState>			pSamplerState;
 	D3D11_MAPPED_SUBRESOURCE							mappedSysBufferTexture;
-	Surface												sysBuffer;
+	// presentation thread, frame n is handed over by signaling frameSubmitted with n,
+	// the thread signals framePresented with n after the flip
+	std::thread											presenter;
+	Fence												frameSubmitted;
+	Fence												framePresented;
+	std::atomic<bool>									quitting;
+	std::atomic<bool>									presentFailed;
+	std::exception_ptr									presentError;
+	unsigned int										maxFramesInFlight;
+#endif
+	// frame n (counting from 1) is drawn into sysBuffers[(n - 1) % size]
+	std::vector<Surface>								sysBuffers;
+	// the buffer of the frame being drawn
+	Surface*											pSysBuffer;
+	// frames finished so far
+	uint64_t											frameIndex = 0u;
+	// BeginFrame's clear is applied lazily, only to pixels the frame did not draw
+	FastClear											fastClear;
+	FrameCapture*										pCapture = nullptr;
+	// DrawLinesAA's pixel batch (kept to reuse its capacity)
+	std::vector<unsigned int>							lineOffsets;
+	std::vector<unsigned char>							lineCoverage;
 public:
 	static constexpr unsigned int ScreenWidth = 1000u;
 	static constexpr unsigned int ScreenHeight = 1000u;
+private:
+	// most pixels a wu line can cover (2 per step along the longer side of the screen)
+	static constexpr size_t MaxLinePixels = 2u * (ScreenWidth > ScreenHeight ? ScreenWidth : ScreenHeight);
 };
\ No newline at end of file
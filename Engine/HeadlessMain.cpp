@@ -0,0 +1,215 @@
+// entry point of the headless benchmark driver (built with CHILI_HEADLESS defined,
+// without Main.cpp, MainWindow.cpp, Game.cpp, GDIPlusManager.cpp and DXErr.cpp)
+// renders scenes into the offscreen sysbuffer as fast as possible, no window and no vsync
+//
+//   HeadlessMain [--scene n] [--frames n] [--warmup n] [--times file.csv] [--save file.png]
+//                [--texture-bench image]
+//
+// without --scene every scene is run in turn
+#ifdef CHILI_HEADLESS
+#include "Graphics.h"
+#include "Keyboard.h"
+#include "Mouse.h"
+#include "CubeSolidScene.h"
+#include "CubeVertexColorScene.h"
+#include "CubeSkinScene.h"
+#include "CubeGridScene.h"
+#include "TextureBenchmark.h"
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	class Options
+	{
+	public:
+		int scene = -1;
+		int nFrames = 500;
+		int nWarmup = 20;
+		std::string timesFile;
+		std::string saveFile;
+		std::string textureBenchImage;
+	};
+
+	std::wstring Widen( const std::string& s )
+	{
+		return std::wstring( s.begin(),s.end() );
+	}
+
+	std::vector<std::unique_ptr<Scene>> MakeScenes( Graphics& gfx )
+	{
+		std::vector<std::unique_ptr<Scene>> scenes;
+		scenes.push_back( std::make_unique<CubeSolidScene>( gfx ) );
+		scenes.push_back( std::make_unique<CubeVertexColorScene>( gfx ) );
+		scenes.push_back( std::make_unique<CubeSkinScene>( gfx,L"Images/office_skin.jpg" ) );
+		scenes.push_back( std::make_unique<CubeGridScene>( gfx ) );
+		return scenes;
+	}
+
+	// milliseconds of the frame at fraction p of the sorted frame times
+	double Percentile( const std::vector<double>& sorted,double p )
+	{
+		const size_t i = std::min( sorted.size() - 1u,size_t( p * double( sorted.size() ) ) );
+		return sorted[i];
+	}
+
+	// returns the time of every measured frame in milliseconds
+	std::vector<double> RunScene( Graphics& gfx,Scene& scene,const Options& options )
+	{
+		typedef std::chrono::steady_clock Clock;
+		// no input arrives, the scene is updated with an empty keyboard and mouse
+		Keyboard kbd;
+		Mouse mouse;
+		const float dt = 1.0f / 60.0f;
+		std::vector<double> times;
+		times.reserve( size_t( options.nFrames ) );
+		for( int i = 0; i < options.nWarmup + options.nFrames; i++ )
+		{
+			const auto start = Clock::now();
+			gfx.BeginFrame();
+			scene.Update( kbd,mouse,dt );
+			scene.Draw();
+			gfx.EndFrame();
+			const auto end = Clock::now();
+			if( i >= options.nWarmup )
+			{
+				times.push_back( std::chrono::duration<double,std::milli>( end - start ).count() );
+			}
+		}
+		return times;
+	}
+
+	void Report( const std::string& name,const std::vector<double>& times )
+	{
+		std::vector<double> sorted = times;
+		std::sort( sorted.begin(),sorted.end() );
+		double total = 0.0;
+		for( const double t : times )
+		{
+			total += t;
+		}
+		const double mean = total / double( times.size() );
+		printf( "%s\n",name.c_str() );
+		printf( "  %zu frames in %.1f ms: %.1f fps\n",times.size(),total,1000.0 / mean );
+		printf( "  frame ms: mean %.3f  min %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+			mean,sorted.front(),Percentile( sorted,0.5 ),Percentile( sorted,0.95 ),
+			Percentile( sorted,0.99 ),sorted.back() );
+	}
+
+	void RunTextureBench( const std::string& image )
+	{
+		const Surface surface = Surface::FromFile( Widen( image ) );
+		printf( "texture sampling, %s (%ux%u), bilinear\n",image.c_str(),surface.GetWidth(),surface.GetHeight() );
+		for( const auto& r : TextureBenchmark::Run( surface ) )
+		{
+			printf( "  %-10s %5.1f deg  %6.2f ns/sample\n",TextureBenchmark::GetLayoutName( r.layout ),
+				r.angle * 180.0f / PI,r.nanosecondsPerSample );
+		}
+	}
+
+	bool ParseOptions( int argc,char* argv[],Options& options )
+	{
+		for( int i = 1; i < argc; i++ )
+		{
+			const bool hasValue = i + 1 < argc;
+			if( !strcmp( argv[i],"--scene" ) && hasValue )
+			{
+				options.scene = atoi( argv[++i] );
+			}
+			else if( !strcmp( argv[i],"--frames" ) && hasValue )
+			{
+				options.nFrames = std::max( atoi( argv[++i] ),1 );
+			}
+			else if( !strcmp( argv[i],"--warmup" ) && hasValue )
+			{
+				options.nWarmup = std::max( atoi( argv[++i] ),0 );
+			}
+			else if( !strcmp( argv[i],"--times" ) && hasValue )
+			{
+				options.timesFile = argv[++i];
+			}
+			else if( !strcmp( argv[i],"--save" ) && hasValue )
+			{
+				options.saveFile = argv[++i];
+			}
+			else if( !strcmp( argv[i],"--texture-bench" ) && hasValue )
+			{
+				options.textureBenchImage = argv[++i];
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main( int argc,char* argv[] )
+{
+	Options options;
+	if( !ParseOptions( argc,argv,options ) )
+	{
+		fprintf( stderr,"usage: %s [--scene n] [--frames n] [--warmup n] [--times file.csv] "
+			"[--save file.png] [--texture-bench image]\n",argv[0] );
+		return 2;
+	}
+	try
+	{
+		Graphics gfx;
+		auto scenes = MakeScenes( gfx );
+		if( options.scene >= int( scenes.size() ) )
+		{
+			fprintf( stderr,"there are only %zu scenes\n",scenes.size() );
+			return 2;
+		}
+		std::ofstream timesFile;
+		if( !options.timesFile.empty() )
+		{
+			timesFile.open( options.timesFile );
+			timesFile << "scene,frame,ms\n";
+		}
+		for( int i = 0; i < int( scenes.size() ); i++ )
+		{
+			if( options.scene >= 0 && options.scene != i )
+			{
+				continue;
+			}
+			const std::vector<double> times = RunScene( gfx,*scenes[i],options );
+			Report( std::to_string( i ) + ": " + scenes[i]->GetName(),times );
+			for( size_t f = 0; f < times.size() && timesFile.is_open(); f++ )
+			{
+				timesFile << i << ',' << f << ',' << times[f] << '\n';
+			}
+		}
+		// the last frame drawn
+		if( !options.saveFile.empty() )
+		{
+			gfx.GetFrame().Save( Widen( options.saveFile ) );
+		}
+		if( !options.textureBenchImage.empty() )
+		{
+			RunTextureBench( options.textureBenchImage );
+		}
+	}
+	catch( const ChiliException& e )
+	{
+		const std::wstring message = e.GetFullMessage();
+		fprintf( stderr,"%ls: %ls\n",e.GetExceptionType().c_str(),message.c_str() );
+		return 1;
+	}
+	catch( const std::exception& e )
+	{
+		fprintf( stderr,"%s\n",e.what() );
+		return 1;
+	}
+	return 0;
+}
+#endif
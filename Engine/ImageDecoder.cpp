@@ -0,0 +1,1893 @@
+#include "ImageDecoder.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cassert>
+#include <vector>
+
+#ifndef _CRT_WIDE
+#define _CRT_WIDE_( s ) L ## s
+#define _CRT_WIDE( s ) _CRT_WIDE_( s )
+#endif
+#define IMAGE_DECODER_EXCEPTION( note ) ImageDecoder::Exception( _CRT_WIDE( __FILE__ ),__LINE__,note )
+
+namespace
+{
+	// largest image accepted (guards the size math against corrupt headers)
+	constexpr unsigned int MaxDimension = 1u << 15;
+
+	uint16_t ReadBE16( const unsigned char* p )
+	{
+		return uint16_t( (p[0] << 8) | p[1] );
+	}
+	uint32_t ReadBE32( const unsigned char* p )
+	{
+		return (uint32_t( p[0] ) << 24) | (uint32_t( p[1] ) << 16) | (uint32_t( p[2] ) << 8) | p[3];
+	}
+	uint16_t ReadLE16( const unsigned char* p )
+	{
+		return uint16_t( p[0] | (p[1] << 8) );
+	}
+	uint32_t ReadLE32( const unsigned char* p )
+	{
+		return p[0] | (uint32_t( p[1] ) << 8) | (uint32_t( p[2] ) << 16) | (uint32_t( p[3] ) << 24);
+	}
+	unsigned char Clamp8( int v )
+	{
+		return (unsigned char)( v < 0 ? 0 : (v > 255 ? 255 : v) );
+	}
+	unsigned char Clamp8( int64_t v )
+	{
+		return (unsigned char)( v < 0 ? 0 : (v > 255 ? 255 : v) );
+	}
+	void CheckDimensions( unsigned int width,unsigned int height )
+	{
+		if( width == 0u || height == 0u || width > MaxDimension || height > MaxDimension )
+		{
+			throw IMAGE_DECODER_EXCEPTION( L"Image dimensions out of range." );
+		}
+	}
+
+	// zlib (deflate) decompressor
+	class Inflater
+	{
+	public:
+		Inflater( const unsigned char* pSrc,size_t srcSize )
+			:
+			pSrc( pSrc ),
+			pEnd( pSrc + srcSize )
+		{}
+		// the stream has to inflate to exactly dstSize bytes
+		void Inflate( unsigned char* pDst,size_t dstSize )
+		{
+			if( pEnd - pSrc < 2 || (pSrc[0] & 0x0Fu) != 8u || ReadBE16( pSrc ) % 31u != 0u || (pSrc[1] & 0x20u) )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad zlib header." );
+			}
+			pSrc += 2;
+			pOut = pDst;
+			pOutBegin = pDst;
+			pOutEnd = pDst + dstSize;
+
+			bool final = false;
+			while( !final )
+			{
+				final = GetBits( 1u ) != 0u;
+				switch( GetBits( 2u ) )
+				{
+				case 0u:
+					CopyStored();
+					break;
+				case 1u:
+					InflateBlock( GetFixedTables().first,GetFixedTables().second );
+					break;
+				case 2u:
+				{
+					Huffman lit;
+					Huffman dist;
+					ReadDynamicTables( lit,dist );
+					InflateBlock( lit,dist );
+					break;
+				}
+				default:
+					throw IMAGE_DECODER_EXCEPTION( L"Bad deflate block type." );
+				}
+			}
+			// the bit buffer gets zero padded past the end, that is fine as long as no padding got used
+			if( overrun * 8u > bitCount )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Compressed data truncated." );
+			}
+			if( pOut != pOutEnd )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Decompressed data too short." );
+			}
+		}
+	private:
+		// canonical huffman code, codes up to FastBits long decode with one table lookup
+		class Huffman
+		{
+		public:
+			void Build( const unsigned char* lengths,unsigned int nSymbols )
+			{
+				std::fill( std::begin( counts ),std::end( counts ),uint16_t( 0u ) );
+				for( unsigned int s = 0u; s < nSymbols; s++ )
+				{
+					counts[lengths[s]]++;
+				}
+				counts[0] = 0u;
+				// more codes than a length allows means the lengths are garbage
+				int left = 1;
+				uint16_t offsets[16];
+				offsets[1] = 0u;
+				for( unsigned int len = 1u; len < 16u; len++ )
+				{
+					left = (left << 1) - counts[len];
+					if( left < 0 )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Bad huffman code lengths." );
+					}
+					if( len < 15u )
+					{
+						offsets[len + 1u] = offsets[len] + counts[len];
+					}
+				}
+				// symbols sorted by code length, then value (canonical order)
+				for( unsigned int s = 0u; s < nSymbols; s++ )
+				{
+					if( lengths[s] != 0u )
+					{
+						symbols[offsets[lengths[s]]++] = uint16_t( s );
+					}
+				}
+				// deflate sends codes lsb first, so the table is indexed by the bit reversed code
+				std::fill( std::begin( fast ),std::end( fast ),uint16_t( 0u ) );
+				unsigned int code = 0u;
+				unsigned int index = 0u;
+				for( unsigned int len = 1u; len <= FastBits; len++ )
+				{
+					for( unsigned int i = 0u; i < counts[len]; i++,code++,index++ )
+					{
+						unsigned int reversed = 0u;
+						for( unsigned int b = 0u; b < len; b++ )
+						{
+							reversed |= ((code >> b) & 1u) << (len - 1u - b);
+						}
+						for( unsigned int j = reversed; j < (1u << FastBits); j += 1u << len )
+						{
+							fast[j] = uint16_t( (len << 9) | symbols[index] );
+						}
+					}
+					code <<= 1;
+				}
+			}
+		public:
+			static constexpr unsigned int FastBits = 10u;
+			// ( length << 9 ) | symbol, 0 when the code is longer than FastBits
+			uint16_t fast[1u << FastBits];
+			uint16_t counts[16];
+			uint16_t symbols[288];
+		};
+	private:
+		static const std::pair<Huffman,Huffman>& GetFixedTables()
+		{
+			static const std::pair<Huffman,Huffman> tables = []()
+			{
+				std::pair<Huffman,Huffman> t;
+				unsigned char lengths[288];
+				std::fill( lengths,lengths + 144,(unsigned char)8u );
+				std::fill( lengths + 144,lengths + 256,(unsigned char)9u );
+				std::fill( lengths + 256,lengths + 280,(unsigned char)7u );
+				std::fill( lengths + 280,lengths + 288,(unsigned char)8u );
+				t.first.Build( lengths,288u );
+				std::fill( lengths,lengths + 30,(unsigned char)5u );
+				t.second.Build( lengths,30u );
+				return t;
+			}();
+			return tables;
+		}
+		void Refill()
+		{
+			if( pEnd - pSrc >= 8 )
+			{
+				// load 8 bytes and keep the whole ones that fit, bits above bitCount
+				// are already the right values so or-ing them in again is harmless
+				uint64_t word;
+				memcpy( &word,pSrc,sizeof( word ) );
+				bitBuf |= word << bitCount;
+				pSrc += (63u - bitCount) >> 3;
+				bitCount |= 56u;
+				return;
+			}
+			while( bitCount <= 56u )
+			{
+				uint64_t b = 0u;
+				if( pSrc < pEnd )
+				{
+					b = *pSrc++;
+				}
+				else
+				{
+					overrun++;
+				}
+				bitBuf |= b << bitCount;
+				bitCount += 8u;
+			}
+		}
+		unsigned int GetBits( unsigned int n )
+		{
+			if( bitCount < n )
+			{
+				Refill();
+			}
+			const unsigned int v = (unsigned int)( bitBuf & ((uint64_t( 1u ) << n) - 1u) );
+			bitBuf >>= n;
+			bitCount -= n;
+			return v;
+		}
+		unsigned int Decode( const Huffman& h )
+		{
+			if( bitCount < 15u )
+			{
+				Refill();
+			}
+			const unsigned int entry = h.fast[bitBuf & ((1u << Huffman::FastBits) - 1u)];
+			if( entry != 0u )
+			{
+				bitBuf >>= entry >> 9;
+				bitCount -= entry >> 9;
+				return entry & 0x1FFu;
+			}
+			// long code, walk the canonical code one bit at a time
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for( unsigned int len = 1u; len < 16u; len++ )
+			{
+				code |= int( bitBuf & 1u );
+				bitBuf >>= 1;
+				bitCount--;
+				const int count = h.counts[len];
+				if( code - count < first )
+				{
+					return h.symbols[index + (code - first)];
+				}
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			throw IMAGE_DECODER_EXCEPTION( L"Bad huffman code." );
+		}
+		void CopyStored()
+		{
+			// stored blocks start on a byte boundary
+			GetBits( bitCount & 7u );
+			const unsigned int len = GetBits( 16u );
+			const unsigned int nlen = GetBits( 16u );
+			if( len != (~nlen & 0xFFFFu) || len > size_t( pOutEnd - pOut ) )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad stored deflate block." );
+			}
+			for( unsigned int i = 0u; i < len; i++ )
+			{
+				*pOut++ = (unsigned char)GetBits( 8u );
+			}
+		}
+		void ReadDynamicTables( Huffman& lit,Huffman& dist )
+		{
+			static constexpr unsigned char order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+			const unsigned int nLit = GetBits( 5u ) + 257u;
+			const unsigned int nDist = GetBits( 5u ) + 1u;
+			const unsigned int nCodeLen = GetBits( 4u ) + 4u;
+			if( nLit > 286u || nDist > 30u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad dynamic deflate header." );
+			}
+			unsigned char lengths[288 + 32] = {};
+			for( unsigned int i = 0u; i < nCodeLen; i++ )
+			{
+				lengths[order[i]] = (unsigned char)GetBits( 3u );
+			}
+			Huffman codeLen;
+			codeLen.Build( lengths,19u );
+
+			// literal/length and distance code lengths are one run length coded sequence
+			unsigned int n = 0u;
+			while( n < nLit + nDist )
+			{
+				const unsigned int sym = Decode( codeLen );
+				if( sym < 16u )
+				{
+					lengths[n++] = (unsigned char)sym;
+					continue;
+				}
+				unsigned char value = 0u;
+				unsigned int repeat;
+				if( sym == 16u )
+				{
+					if( n == 0u )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Bad dynamic deflate code lengths." );
+					}
+					value = lengths[n - 1u];
+					repeat = 3u + GetBits( 2u );
+				}
+				else if( sym == 17u )
+				{
+					repeat = 3u + GetBits( 3u );
+				}
+				else
+				{
+					repeat = 11u + GetBits( 7u );
+				}
+				if( n + repeat > nLit + nDist )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad dynamic deflate code lengths." );
+				}
+				std::fill_n( lengths + n,repeat,value );
+				n += repeat;
+			}
+			if( lengths[256] == 0u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Deflate block without end code." );
+			}
+			lit.Build( lengths,nLit );
+			dist.Build( lengths + nLit,nDist );
+		}
+		void InflateBlock( const Huffman& lit,const Huffman& dist )
+		{
+			static constexpr uint16_t lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+			static constexpr unsigned char lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+			static constexpr uint16_t distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+			static constexpr unsigned char distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+			for( ;; )
+			{
+				unsigned int sym = Decode( lit );
+				if( sym < 256u )
+				{
+					if( pOut == pOutEnd )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Decompressed data too long." );
+					}
+					*pOut++ = (unsigned char)sym;
+					continue;
+				}
+				if( sym == 256u )
+				{
+					return;
+				}
+				sym -= 257u;
+				if( sym >= 29u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad deflate length code." );
+				}
+				const size_t length = lengthBase[sym] + GetBits( lengthExtra[sym] );
+				const unsigned int d = Decode( dist );
+				if( d >= 30u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad deflate distance code." );
+				}
+				const size_t distance = distBase[d] + GetBits( distExtra[d] );
+				if( distance > size_t( pOut - pOutBegin ) || length > size_t( pOutEnd - pOut ) )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad deflate back reference." );
+				}
+				// byte by byte, the source may overlap the bytes being written
+				const unsigned char* pFrom = pOut - distance;
+				for( size_t i = 0u; i < length; i++ )
+				{
+					pOut[i] = pFrom[i];
+				}
+				pOut += length;
+			}
+		}
+	private:
+		const unsigned char* pSrc;
+		const unsigned char* pEnd;
+		uint64_t bitBuf = 0u;
+		unsigned int bitCount = 0u;
+		// zero bytes fed in past the end of the input
+		unsigned int overrun = 0u;
+		unsigned char* pOut = nullptr;
+		unsigned char* pOutBegin = nullptr;
+		unsigned char* pOutEnd = nullptr;
+	};
+
+	class PngDecoder
+	{
+	public:
+		PngDecoder( const unsigned char* pData,size_t size )
+		{
+			// walk the chunks, the image data is only referenced here
+			size_t pos = 8u;
+			bool gotHeader = false;
+			for( ;; )
+			{
+				if( size - pos < 12u || ReadBE32( pData + pos ) > size - pos - 12u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"PNG chunk runs past the end of the file." );
+				}
+				const uint32_t length = ReadBE32( pData + pos );
+				const unsigned char* pType = pData + pos + 4u;
+				const unsigned char* pChunk = pData + pos + 8u;
+				pos += length + 12u;
+				if( !memcmp( pType,"IHDR",4 ) )
+				{
+					if( length < 13u )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Bad PNG header." );
+					}
+					width = ReadBE32( pChunk );
+					height = ReadBE32( pChunk + 4u );
+					bitDepth = pChunk[8];
+					colorType = pChunk[9];
+					interlaced = pChunk[12] != 0u;
+					if( pChunk[10] != 0u || pChunk[11] != 0u || pChunk[12] > 1u )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Unknown PNG compression, filter or interlace method." );
+					}
+					CheckDimensions( width,height );
+					gotHeader = true;
+				}
+				else if( !gotHeader )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"PNG does not start with a header chunk." );
+				}
+				else if( !memcmp( pType,"PLTE",4 ) )
+				{
+					nPaletteEntries = std::min( length / 3u,256u );
+					for( unsigned int i = 0u; i < nPaletteEntries; i++ )
+					{
+						palette[i] = Color( 255u,pChunk[i * 3u],pChunk[i * 3u + 1u],pChunk[i * 3u + 2u] );
+					}
+				}
+				else if( !memcmp( pType,"tRNS",4 ) )
+				{
+					if( colorType == 3u )
+					{
+						for( unsigned int i = 0u; i < std::min( length,256u ); i++ )
+						{
+							palette[i] = Color( Color( palette[i].dword & 0xFFFFFFu ),pChunk[i] );
+						}
+					}
+					else if( colorType == 0u && length >= 2u )
+					{
+						hasKey = true;
+						key[0] = key[1] = key[2] = ReadBE16( pChunk );
+					}
+					else if( colorType == 2u && length >= 6u )
+					{
+						hasKey = true;
+						for( unsigned int c = 0u; c < 3u; c++ )
+						{
+							key[c] = ReadBE16( pChunk + c * 2u );
+						}
+					}
+				}
+				else if( !memcmp( pType,"IDAT",4 ) )
+				{
+					chunks.emplace_back( pChunk,length );
+				}
+				else if( !memcmp( pType,"IEND",4 ) )
+				{
+					break;
+				}
+				else if( !(pType[0] & 0x20u) )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"PNG uses an unknown critical chunk." );
+				}
+			}
+
+			switch( colorType )
+			{
+			case 0u:
+				channels = 1u;
+				break;
+			case 2u:
+				channels = 3u;
+				break;
+			case 3u:
+				channels = 1u;
+				if( nPaletteEntries == 0u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Palette PNG without a palette." );
+				}
+				break;
+			case 4u:
+				channels = 2u;
+				break;
+			case 6u:
+				channels = 4u;
+				break;
+			default:
+				throw IMAGE_DECODER_EXCEPTION( L"Bad PNG color type." );
+			}
+			const bool lowDepthAllowed = colorType == 0u || colorType == 3u;
+			const bool depthOk = bitDepth == 8u || (bitDepth == 16u && colorType != 3u) ||
+				(lowDepthAllowed && (bitDepth == 1u || bitDepth == 2u || bitDepth == 4u));
+			if( !depthOk )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad PNG bit depth." );
+			}
+			if( chunks.empty() )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"PNG without image data." );
+			}
+		}
+		unsigned int GetWidth() const
+		{
+			return width;
+		}
+		unsigned int GetHeight() const
+		{
+			return height;
+		}
+		void Decode( Color* pDst,unsigned int pitch ) const
+		{
+			// adam7 passes (x0,y0,dx,dy), or a single pass covering every pixel
+			static constexpr unsigned int adam7[7][4] = {
+				{ 0,0,8,8 },{ 4,0,8,8 },{ 0,4,4,8 },{ 2,0,4,4 },{ 0,2,2,4 },{ 1,0,2,2 },{ 0,1,1,2 }
+			};
+			static constexpr unsigned int single[1][4] = { { 0,0,1,1 } };
+			const auto passes = interlaced ? adam7 : single;
+			const unsigned int nPasses = interlaced ? 7u : 1u;
+
+			const unsigned int bitsPerPixel = channels * bitDepth;
+			const unsigned int filterStride = std::max( bitsPerPixel / 8u,1u );
+			size_t rawSize = 0u;
+			for( unsigned int p = 0u; p < nPasses; p++ )
+			{
+				const unsigned int passWidth = GetPassSize( width,passes[p][0],passes[p][2] );
+				const unsigned int passHeight = GetPassSize( height,passes[p][1],passes[p][3] );
+				if( passWidth != 0u )
+				{
+					rawSize += size_t( passHeight ) * (1u + (size_t( passWidth ) * bitsPerPixel + 7u) / 8u);
+				}
+			}
+
+			// the deflate stream may be split over any number of chunks
+			std::vector<unsigned char> compressed;
+			const unsigned char* pCompressed = chunks.front().first;
+			size_t compressedSize = chunks.front().second;
+			if( chunks.size() > 1u )
+			{
+				for( const auto& c : chunks )
+				{
+					compressed.insert( compressed.end(),c.first,c.first + c.second );
+				}
+				pCompressed = compressed.data();
+				compressedSize = compressed.size();
+			}
+			std::vector<unsigned char> raw( rawSize );
+			Inflater( pCompressed,compressedSize ).Inflate( raw.data(),rawSize );
+
+			const std::vector<unsigned char> zeroRow( (size_t( width ) * bitsPerPixel + 7u) / 8u,0u );
+			unsigned char* pRaw = raw.data();
+			for( unsigned int p = 0u; p < nPasses; p++ )
+			{
+				const unsigned int x0 = passes[p][0];
+				const unsigned int y0 = passes[p][1];
+				const unsigned int dx = passes[p][2];
+				const unsigned int dy = passes[p][3];
+				const unsigned int passWidth = GetPassSize( width,x0,dx );
+				const unsigned int passHeight = GetPassSize( height,y0,dy );
+				if( passWidth == 0u )
+				{
+					continue;
+				}
+				const size_t rowBytes = (size_t( passWidth ) * bitsPerPixel + 7u) / 8u;
+				const unsigned char* pPrev = zeroRow.data();
+				for( unsigned int y = 0u; y < passHeight; y++ )
+				{
+					unsigned char* const pRow = pRaw + 1u;
+					Unfilter( pRaw[0],pRow,pPrev,rowBytes,filterStride );
+					ConvertRow( pRow,passWidth,pDst + size_t( y0 + y * dy ) * pitch + x0,dx );
+					pPrev = pRow;
+					pRaw += rowBytes + 1u;
+				}
+			}
+		}
+	private:
+		static unsigned int GetPassSize( unsigned int size,unsigned int start,unsigned int step )
+		{
+			return size > start ? (size - start + step - 1u) / step : 0u;
+		}
+		static void Unfilter( unsigned char filter,unsigned char* pRow,const unsigned char* pPrev,size_t n,unsigned int stride )
+		{
+			switch( filter )
+			{
+			case 0u:
+				break;
+			case 1u:
+				for( size_t i = stride; i < n; i++ )
+				{
+					pRow[i] += pRow[i - stride];
+				}
+				break;
+			case 2u:
+				for( size_t i = 0u; i < n; i++ )
+				{
+					pRow[i] += pPrev[i];
+				}
+				break;
+			case 3u:
+				for( size_t i = 0u; i < std::min( size_t( stride ),n ); i++ )
+				{
+					pRow[i] += pPrev[i] >> 1;
+				}
+				for( size_t i = stride; i < n; i++ )
+				{
+					pRow[i] += (unsigned char)((pRow[i - stride] + pPrev[i]) >> 1);
+				}
+				break;
+			case 4u:
+				for( size_t i = 0u; i < std::min( size_t( stride ),n ); i++ )
+				{
+					pRow[i] += pPrev[i];
+				}
+				for( size_t i = stride; i < n; i++ )
+				{
+					const int a = pRow[i - stride];
+					const int b = pPrev[i];
+					const int c = pPrev[i - stride];
+					const int pa = std::abs( b - c );
+					const int pb = std::abs( a - c );
+					const int pc = std::abs( a + b - 2 * c );
+					pRow[i] += (unsigned char)((pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c));
+				}
+				break;
+			default:
+				throw IMAGE_DECODER_EXCEPTION( L"Bad PNG filter type." );
+			}
+		}
+		// one unfiltered row of count pixels out to every step'th pixel from pOut
+		void ConvertRow( const unsigned char* pRow,unsigned int count,Color* pOut,unsigned int step ) const
+		{
+			if( bitDepth < 8u )
+			{
+				const unsigned int mask = (1u << bitDepth) - 1u;
+				for( unsigned int i = 0u; i < count; i++,pOut += step )
+				{
+					const unsigned int bit = i * bitDepth;
+					const unsigned int v = (pRow[bit / 8u] >> (8u - bitDepth - bit % 8u)) & mask;
+					if( colorType == 3u )
+					{
+						*pOut = palette[v];
+					}
+					else
+					{
+						const unsigned char g = (unsigned char)(v * 255u / mask);
+						*pOut = Color( (hasKey && v == key[0]) ? 0u : 255u,g,g,g );
+					}
+				}
+				return;
+			}
+			// 16 bit samples keep their high byte (the key is compared at full precision)
+			const unsigned int bytes = bitDepth / 8u;
+			const unsigned int pixelBytes = channels * bytes;
+			auto Sample = [bytes]( const unsigned char* p ) -> unsigned int
+			{
+				return bytes == 1u ? p[0] : ReadBE16( p );
+			};
+			for( unsigned int i = 0u; i < count; i++,pRow += pixelBytes,pOut += step )
+			{
+				switch( colorType )
+				{
+				case 0u:
+				{
+					const unsigned char g = pRow[0];
+					*pOut = Color( (hasKey && Sample( pRow ) == key[0]) ? 0u : 255u,g,g,g );
+					break;
+				}
+				case 2u:
+				{
+					const bool keyed = hasKey && Sample( pRow ) == key[0] &&
+						Sample( pRow + bytes ) == key[1] && Sample( pRow + 2u * bytes ) == key[2];
+					*pOut = Color( keyed ? 0u : 255u,pRow[0],pRow[bytes],pRow[2u * bytes] );
+					break;
+				}
+				case 3u:
+					*pOut = palette[pRow[0]];
+					break;
+				case 4u:
+					*pOut = Color( pRow[bytes],pRow[0],pRow[0],pRow[0] );
+					break;
+				default:
+					*pOut = Color( pRow[3u * bytes],pRow[0],pRow[bytes],pRow[2u * bytes] );
+					break;
+				}
+			}
+		}
+	private:
+		unsigned int width = 0u;
+		unsigned int height = 0u;
+		unsigned int bitDepth = 0u;
+		unsigned int colorType = 0u;
+		unsigned int channels = 0u;
+		bool interlaced = false;
+		// unused entries stay opaque black
+		Color palette[256] = {};
+		unsigned int nPaletteEntries = 0u;
+		// color key from tRNS for gray and rgb images
+		bool hasKey = false;
+		unsigned int key[3] = {};
+		std::vector<std::pair<const unsigned char*,size_t>> chunks;
+	};
+
+	// one dimensional 8 point islow integer idct (loeffler, wiener and moschytz)
+	// constants are 12 bit fixed point
+	template<typename T>
+	class Idct1D
+	{
+	public:
+		Idct1D( T s0,T s1,T s2,T s3,T s4,T s5,T s6,T s7 )
+		{
+			// even part
+			T p1 = (s2 + s6) * Fix( 0.5411961f );
+			const T e2 = p1 + s6 * Fix( -1.847759065f );
+			const T e3 = p1 + s2 * Fix( 0.765366865f );
+			const T e0 = (s0 + s4) * 4096;
+			const T e1 = (s0 - s4) * 4096;
+			x0 = e0 + e3;
+			x3 = e0 - e3;
+			x1 = e1 + e2;
+			x2 = e1 - e2;
+			// odd part
+			T p3 = s7 + s3;
+			T p4 = s5 + s1;
+			p1 = s7 + s1;
+			T p2 = s5 + s3;
+			const T p5 = (p3 + p4) * Fix( 1.175875602f );
+			t0 = s7 * Fix( 0.298631336f );
+			t1 = s5 * Fix( 2.053119869f );
+			t2 = s3 * Fix( 3.072711026f );
+			t3 = s1 * Fix( 1.501321110f );
+			p1 = p5 + p1 * Fix( -0.899976223f );
+			p2 = p5 + p2 * Fix( -2.562915447f );
+			p3 = p3 * Fix( -1.961570560f );
+			p4 = p4 * Fix( -0.390180644f );
+			t3 += p1 + p4;
+			t2 += p2 + p3;
+			t1 += p2 + p4;
+			t0 += p1 + p3;
+		}
+		static constexpr int Fix( float x )
+		{
+			return int( x * 4096.0f + 0.5f );
+		}
+	public:
+		T x0,x1,x2,x3;
+		T t0,t1,t2,t3;
+	};
+
+	// baseline and progressive huffman coded jpeg
+	class JpegDecoder
+	{
+	public:
+		// only reads up to the frame header
+		JpegDecoder( const unsigned char* pData,size_t size )
+			:
+			pData( pData ),
+			size( size )
+		{
+			size_t pos = 2u;
+			for( ;; )
+			{
+				const unsigned char marker = NextMarker( pos );
+				if( marker >= 0xC0u && marker <= 0xCFu && marker != 0xC4u && marker != 0xC8u && marker != 0xCCu )
+				{
+					ReadFrameHeader( marker,pos );
+					return;
+				}
+				if( marker == 0xD9u || marker == 0xDAu )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"JPEG without a frame header." );
+				}
+				if( !IsStandalone( marker ) )
+				{
+					pos += ReadSegmentLength( pos );
+				}
+			}
+		}
+		unsigned int GetWidth() const
+		{
+			return width;
+		}
+		unsigned int GetHeight() const
+		{
+			return height;
+		}
+		void Decode( Color* pDst,unsigned int pitch )
+		{
+			size_t pos = 2u;
+			for( bool done = false; !done; )
+			{
+				const unsigned char marker = NextMarker( pos );
+				switch( marker )
+				{
+				case 0xDBu:
+					ReadQuantTables( pos );
+					break;
+				case 0xC4u:
+					ReadHuffmanTables( pos );
+					break;
+				case 0xDDu:
+					restartInterval = ReadBE16( Segment( pos,2u ) );
+					break;
+				case 0xEEu:
+				{
+					// adobe marker, transform 0 means the 3 components are rgb
+					const size_t length = ReadSegmentLength( pos );
+					if( length >= 14u && !memcmp( pData + pos + 2u,"Adobe",5 ) )
+					{
+						adobeTransform = pData[pos + 13u];
+					}
+					break;
+				}
+				case 0xDAu:
+					pos = DecodeScan( pos );
+					// the scan data has no length, pos is already past it
+					continue;
+				case 0xD9u:
+					done = true;
+					continue;
+				default:
+					break;
+				}
+				if( IsStandalone( marker ) )
+				{
+					continue;
+				}
+				if( marker >= 0xC0u && marker <= 0xCFu && marker != 0xC4u && marker != 0xC8u && marker != 0xCCu )
+				{
+					ReadFrameHeader( marker,pos );
+				}
+				pos += ReadSegmentLength( pos );
+				// files cut off before the end marker decode as far as they go
+				if( pos + 2u > size )
+				{
+					break;
+				}
+			}
+			if( components.empty() || components.front().coefs.empty() )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"JPEG without image data." );
+			}
+			Output( pDst,pitch );
+		}
+	private:
+		class Huffman
+		{
+		public:
+			// a table the file never defines decodes nothing
+			Huffman()
+			{
+				std::fill( std::begin( fast ),std::end( fast ),(unsigned char)255u );
+				std::fill( std::begin( maxCode ),std::end( maxCode ),0u );
+				maxCode[17] = 0xFFFFFFFFu;
+			}
+			void Build( const unsigned char* counts,const unsigned char* values_in,unsigned int nValues_in )
+			{
+				nValues = nValues_in;
+				std::copy( values_in,values_in + nValues,values );
+				std::fill( std::begin( fast ),std::end( fast ),(unsigned char)255u );
+				unsigned int code = 0u;
+				unsigned int index = 0u;
+				for( unsigned int len = 1u; len <= 16u; len++ )
+				{
+					delta[len] = int( index ) - int( code );
+					for( unsigned int i = 0u; i < counts[len - 1u]; i++,code++,index++ )
+					{
+						sizes[index] = (unsigned char)len;
+						if( len <= FastBits )
+						{
+							// jpeg codes are msb first, so every index starting with the code maps to it
+							const unsigned int first = code << (FastBits - len);
+							std::fill_n( fast + first,1u << (FastBits - len),(unsigned char)index );
+						}
+					}
+					if( code > (1u << len) )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG huffman table." );
+					}
+					// upper bound of the codes of this length, left aligned to 16 bits
+					maxCode[len] = code << (16u - len);
+					code <<= 1;
+				}
+				maxCode[17] = 0xFFFFFFFFu;
+			}
+		public:
+			static constexpr unsigned int FastBits = 9u;
+			// index into values, 255 when the code is longer than FastBits
+			unsigned char fast[1u << FastBits];
+			unsigned int nValues = 0u;
+			unsigned char values[256];
+			unsigned char sizes[257];
+			uint32_t maxCode[18];
+			int delta[17];
+		};
+		class Component
+		{
+		public:
+			unsigned int id = 0u;
+			unsigned int h = 1u;
+			unsigned int v = 1u;
+			unsigned int quantTable = 0u;
+			unsigned int dcTable = 0u;
+			unsigned int acTable = 0u;
+			// blocks covering whole mcus
+			unsigned int blocksPerLine = 0u;
+			unsigned int blocksPerColumn = 0u;
+			// blocks covering the component's own samples (non-interleaved scans)
+			unsigned int usedBlocksPerLine = 0u;
+			unsigned int usedBlocksPerColumn = 0u;
+			int dcPred = 0;
+			// coefficients of each block in natural order, not dequantized
+			std::vector<short> coefs;
+		};
+	private:
+		// markers without a length or payload
+		static bool IsStandalone( unsigned char marker )
+		{
+			return marker == 0x01u || (marker >= 0xD0u && marker <= 0xD8u);
+		}
+		unsigned char NextMarker( size_t& pos ) const
+		{
+			// skip anything that is not a marker (and fill bytes)
+			while( pos + 1u < size && !(pData[pos] == 0xFFu && pData[pos + 1u] != 0x00u && pData[pos + 1u] != 0xFFu) )
+			{
+				pos++;
+			}
+			if( pos + 1u >= size )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"JPEG ended early." );
+			}
+			pos += 2u;
+			return pData[pos - 1u];
+		}
+		size_t ReadSegmentLength( size_t pos ) const
+		{
+			if( pos + 2u > size )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"JPEG ended early." );
+			}
+			const size_t length = ReadBE16( pData + pos );
+			if( length < 2u || pos + length > size )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG segment length." );
+			}
+			return length;
+		}
+		// start of the segment payload, which has to hold at least minLength bytes
+		const unsigned char* Segment( size_t pos,size_t minLength ) const
+		{
+			if( ReadSegmentLength( pos ) < minLength + 2u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"JPEG segment too short." );
+			}
+			return pData + pos + 2u;
+		}
+		void ReadFrameHeader( unsigned char marker,size_t pos )
+		{
+			if( marker != 0xC0u && marker != 0xC1u && marker != 0xC2u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Only baseline and progressive huffman JPEGs are supported." );
+			}
+			progressive = marker == 0xC2u;
+			const unsigned char* p = Segment( pos,6u );
+			height = ReadBE16( p + 1u );
+			width = ReadBE16( p + 3u );
+			const unsigned int nComponents = p[5];
+			if( p[0] != 8u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Only 8 bit JPEGs are supported." );
+			}
+			CheckDimensions( width,height );
+			if( nComponents != 1u && nComponents != 3u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Only grayscale and 3 component JPEGs are supported." );
+			}
+			p = Segment( pos,6u + 3u * nComponents );
+			components.clear();
+			hMax = 1u;
+			vMax = 1u;
+			for( unsigned int i = 0u; i < nComponents; i++ )
+			{
+				Component c;
+				c.id = p[6u + i * 3u];
+				c.h = p[7u + i * 3u] >> 4;
+				c.v = p[7u + i * 3u] & 0x0Fu;
+				c.quantTable = p[8u + i * 3u];
+				if( c.h < 1u || c.h > 4u || c.v < 1u || c.v > 4u || c.quantTable > 3u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG component." );
+				}
+				hMax = std::max( hMax,c.h );
+				vMax = std::max( vMax,c.v );
+				components.push_back( std::move( c ) );
+			}
+			mcusPerLine = (width + 8u * hMax - 1u) / (8u * hMax);
+			mcusPerColumn = (height + 8u * vMax - 1u) / (8u * vMax);
+			for( auto& c : components )
+			{
+				c.blocksPerLine = mcusPerLine * c.h;
+				c.blocksPerColumn = mcusPerColumn * c.v;
+				c.usedBlocksPerLine = ((width * c.h + hMax - 1u) / hMax + 7u) / 8u;
+				c.usedBlocksPerColumn = ((height * c.v + vMax - 1u) / vMax + 7u) / 8u;
+			}
+		}
+		void ReadQuantTables( size_t pos )
+		{
+			const size_t end = pos + ReadSegmentLength( pos );
+			for( pos += 2u; pos < end; )
+			{
+				const unsigned int precision = pData[pos] >> 4;
+				const unsigned int table = pData[pos] & 0x0Fu;
+				const size_t bytes = precision ? 128u : 64u;
+				if( table > 3u || pos + 1u + bytes > end )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG quantization table." );
+				}
+				for( unsigned int i = 0u; i < 64u; i++ )
+				{
+					quant[table][zigzag[i]] = precision ? ReadBE16( pData + pos + 1u + i * 2u ) : pData[pos + 1u + i];
+				}
+				pos += 1u + bytes;
+			}
+		}
+		void ReadHuffmanTables( size_t pos )
+		{
+			const size_t end = pos + ReadSegmentLength( pos );
+			for( pos += 2u; pos < end; )
+			{
+				if( pos + 17u > end )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG huffman table." );
+				}
+				const unsigned int tableClass = pData[pos] >> 4;
+				const unsigned int table = pData[pos] & 0x0Fu;
+				const unsigned char* pCounts = pData + pos + 1u;
+				unsigned int nValues = 0u;
+				for( unsigned int i = 0u; i < 16u; i++ )
+				{
+					nValues += pCounts[i];
+				}
+				if( tableClass > 1u || table > 3u || nValues > 256u || pos + 17u + nValues > end )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG huffman table." );
+				}
+				(tableClass ? ac : dc)[table].Build( pCounts,pCounts + 16u,nValues );
+				pos += 17u + nValues;
+			}
+		}
+		// decodes the scan following the header at pos, returns where the entropy coded data ends
+		size_t DecodeScan( size_t pos )
+		{
+			if( components.empty() )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"JPEG scan before the frame header." );
+			}
+			const unsigned char* p = Segment( pos,1u );
+			const unsigned int nScanComponents = p[0];
+			p = Segment( pos,4u + 2u * nScanComponents );
+			if( nScanComponents < 1u || nScanComponents > components.size() )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG scan header." );
+			}
+			Component* scanComponents[4];
+			for( unsigned int i = 0u; i < nScanComponents; i++ )
+			{
+				const unsigned int id = p[1u + i * 2u];
+				const auto it = std::find_if( components.begin(),components.end(),[id]( const Component& c )
+				{
+					return c.id == id;
+				} );
+				const unsigned int tables = p[2u + i * 2u];
+				if( it == components.end() || (tables >> 4) > 3u || (tables & 0x0Fu) > 3u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG scan header." );
+				}
+				it->dcTable = tables >> 4;
+				it->acTable = tables & 0x0Fu;
+				it->dcPred = 0;
+				scanComponents[i] = &*it;
+			}
+			// first scan, components missing from every scan stay flat gray
+			for( auto& c : components )
+			{
+				if( c.coefs.empty() )
+				{
+					c.coefs.assign( size_t( c.blocksPerLine ) * c.blocksPerColumn * 64u,short( 0 ) );
+				}
+			}
+			const unsigned char* pParams = p + 1u + 2u * nScanComponents;
+			spectralStart = pParams[0];
+			spectralEnd = pParams[1];
+			approxHigh = pParams[2] >> 4;
+			approxLow = pParams[2] & 0x0Fu;
+			if( progressive )
+			{
+				const bool dcScan = spectralStart == 0u;
+				if( spectralEnd > 63u || spectralStart > spectralEnd || (dcScan && spectralEnd != 0u) ||
+					(!dcScan && nScanComponents != 1u) || approxLow > 13u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad JPEG progressive scan." );
+				}
+			}
+			else
+			{
+				spectralStart = 0u;
+				spectralEnd = 63u;
+			}
+
+			// entropy coded data starts after the header
+			pBits = pData + pos + ReadSegmentLength( pos );
+			bitBuf = 0u;
+			bitCount = 0u;
+			hitMarker = false;
+			eobRun = 0u;
+			unsigned int restartsLeft = restartInterval;
+			auto HandleRestart = [&]()
+			{
+				if( restartInterval == 0u || --restartsLeft != 0u )
+				{
+					return;
+				}
+				restartsLeft = restartInterval;
+				// drop the padding bits and step over the RSTn marker
+				bitBuf = 0u;
+				bitCount = 0u;
+				hitMarker = false;
+				while( pBits + 1 < pData + size && !(pBits[0] == 0xFFu && pBits[1] != 0x00u && pBits[1] != 0xFFu) )
+				{
+					pBits++;
+				}
+				if( pBits + 1 < pData + size && pBits[1] >= 0xD0u && pBits[1] <= 0xD7u )
+				{
+					pBits += 2;
+				}
+				for( auto& c : components )
+				{
+					c.dcPred = 0;
+				}
+				eobRun = 0u;
+			};
+
+			if( nScanComponents == 1u )
+			{
+				// non-interleaved, blocks in raster order over just the component's samples
+				Component& c = *scanComponents[0];
+				for( unsigned int by = 0u; by < c.usedBlocksPerColumn; by++ )
+				{
+					for( unsigned int bx = 0u; bx < c.usedBlocksPerLine; bx++ )
+					{
+						DecodeBlock( c,&c.coefs[(size_t( by ) * c.blocksPerLine + bx) * 64u] );
+						HandleRestart();
+					}
+				}
+			}
+			else
+			{
+				for( unsigned int my = 0u; my < mcusPerColumn; my++ )
+				{
+					for( unsigned int mx = 0u; mx < mcusPerLine; mx++ )
+					{
+						for( unsigned int i = 0u; i < nScanComponents; i++ )
+						{
+							Component& c = *scanComponents[i];
+							for( unsigned int y = 0u; y < c.v; y++ )
+							{
+								for( unsigned int x = 0u; x < c.h; x++ )
+								{
+									const size_t block = size_t( my * c.v + y ) * c.blocksPerLine + mx * c.h + x;
+									DecodeBlock( c,&c.coefs[block * 64u] );
+								}
+							}
+						}
+						HandleRestart();
+					}
+				}
+			}
+			return size_t( pBits - pData );
+		}
+		void DecodeBlock( Component& c,short* pBlock )
+		{
+			if( !progressive )
+			{
+				pBlock[0] = short( c.dcPred += DecodeDcDiff( c ) );
+				for( unsigned int k = 1u; k < 64u; k++ )
+				{
+					const unsigned int rs = DecodeHuffman( ac[c.acTable] );
+					const unsigned int r = rs >> 4;
+					const unsigned int s = rs & 0x0Fu;
+					if( s == 0u )
+					{
+						if( r != 15u )
+						{
+							break;
+						}
+						k += 15u;
+						continue;
+					}
+					k += r;
+					if( k > 63u )
+					{
+						throw IMAGE_DECODER_EXCEPTION( L"Corrupt JPEG data." );
+					}
+					pBlock[zigzag[k]] = short( Extend( GetBits( s ),s ) );
+				}
+			}
+			else if( spectralStart == 0u )
+			{
+				if( approxHigh == 0u )
+				{
+					c.dcPred += DecodeDcDiff( c );
+					pBlock[0] = short( c.dcPred * (1 << approxLow) );
+				}
+				else if( GetBits( 1u ) )
+				{
+					pBlock[0] |= short( 1 << approxLow );
+				}
+			}
+			else if( approxHigh == 0u )
+			{
+				DecodeAcFirst( c,pBlock );
+			}
+			else
+			{
+				DecodeAcRefine( c,pBlock );
+			}
+		}
+		int DecodeDcDiff( const Component& c )
+		{
+			const unsigned int s = DecodeHuffman( dc[c.dcTable] );
+			if( s > 16u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Corrupt JPEG data." );
+			}
+			return s ? Extend( GetBits( s ),s ) : 0;
+		}
+		void DecodeAcFirst( const Component& c,short* pBlock )
+		{
+			if( eobRun > 0u )
+			{
+				eobRun--;
+				return;
+			}
+			for( unsigned int k = spectralStart; k <= spectralEnd; k++ )
+			{
+				const unsigned int rs = DecodeHuffman( ac[c.acTable] );
+				const unsigned int r = rs >> 4;
+				const unsigned int s = rs & 0x0Fu;
+				if( s == 0u )
+				{
+					if( r < 15u )
+					{
+						// this block and the next eobRun ones end here
+						eobRun = (1u << r) - 1u + GetBits( r );
+						break;
+					}
+					k += 15u;
+					continue;
+				}
+				k += r;
+				if( k > 63u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Corrupt JPEG data." );
+				}
+				pBlock[zigzag[k]] = short( Extend( GetBits( s ),s ) * (1 << approxLow) );
+			}
+		}
+		void DecodeAcRefine( const Component& c,short* pBlock )
+		{
+			const int plus = 1 << approxLow;
+			const int minus = -plus;
+			// a correction bit for every coefficient that is already nonzero
+			auto Refine = [&]( short& coef )
+			{
+				if( GetBits( 1u ) && (coef & plus) == 0 )
+				{
+					coef = short( coef + (coef >= 0 ? plus : minus) );
+				}
+			};
+			unsigned int k = spectralStart;
+			if( eobRun == 0u )
+			{
+				for( ; k <= spectralEnd; k++ )
+				{
+					const unsigned int rs = DecodeHuffman( ac[c.acTable] );
+					int r = int( rs >> 4 );
+					int value = 0;
+					if( (rs & 0x0Fu) != 0u )
+					{
+						value = GetBits( 1u ) ? plus : minus;
+					}
+					else if( r != 15 )
+					{
+						eobRun = (1u << r) + GetBits( (unsigned int)( r ) );
+						break;
+					}
+					// skip r zero coefficients (refining the nonzero ones passed on the way)
+					for( ; k <= spectralEnd; k++ )
+					{
+						short& coef = pBlock[zigzag[k]];
+						if( coef != 0 )
+						{
+							Refine( coef );
+						}
+						else if( --r < 0 )
+						{
+							break;
+						}
+					}
+					if( value != 0 && k <= 63u )
+					{
+						pBlock[zigzag[k]] = short( value );
+					}
+				}
+			}
+			if( eobRun > 0u )
+			{
+				for( ; k <= spectralEnd; k++ )
+				{
+					short& coef = pBlock[zigzag[k]];
+					if( coef != 0 )
+					{
+						Refine( coef );
+					}
+				}
+				eobRun--;
+			}
+		}
+		void FillBits()
+		{
+			// 0xFF 0x00 is a stuffed 0xFF, any other marker ends the data (zeros are fed after it)
+			while( bitCount <= 24u )
+			{
+				unsigned int b = 0u;
+				if( !hitMarker && pBits < pData + size )
+				{
+					b = *pBits;
+					if( b == 0xFFu )
+					{
+						if( pBits + 1 < pData + size && pBits[1] == 0x00u )
+						{
+							pBits += 2;
+						}
+						else
+						{
+							hitMarker = true;
+							b = 0u;
+						}
+					}
+					else
+					{
+						pBits++;
+					}
+				}
+				bitBuf |= b << (24u - bitCount);
+				bitCount += 8u;
+			}
+		}
+		unsigned int GetBits( unsigned int n )
+		{
+			if( n == 0u )
+			{
+				return 0u;
+			}
+			if( bitCount < n )
+			{
+				FillBits();
+			}
+			const unsigned int v = bitBuf >> (32u - n);
+			bitBuf <<= n;
+			bitCount -= n;
+			return v;
+		}
+		unsigned int DecodeHuffman( const Huffman& h )
+		{
+			if( bitCount < 16u )
+			{
+				FillBits();
+			}
+			unsigned int index = h.fast[bitBuf >> (32u - Huffman::FastBits)];
+			unsigned int len;
+			if( index != 255u )
+			{
+				len = h.sizes[index];
+			}
+			else
+			{
+				const uint32_t top = bitBuf >> 16;
+				for( len = Huffman::FastBits + 1u; top >= h.maxCode[len]; len++ );
+				if( len > 16u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Corrupt JPEG data." );
+				}
+				index = (unsigned int)( int( bitBuf >> (32u - len) ) + h.delta[len] );
+				if( index >= h.nValues )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Corrupt JPEG data." );
+				}
+			}
+			bitBuf <<= len;
+			bitCount -= len;
+			return h.values[index];
+		}
+		// s bit magnitude category value to its signed value
+		static int Extend( unsigned int v,unsigned int s )
+		{
+			return v < (1u << (s - 1u)) ? int( v ) - int( (1u << s) - 1u ) : int( v );
+		}
+		// dequantizes and inverse transforms one block into 8x8 samples
+		void TransformBlock( const short* pCoefs,const uint16_t* pQuant,unsigned char* pOut,unsigned int outPitch ) const
+		{
+			// valid 8 bit data stays well inside +-8192
+			// (and the row pass is 64 bit, so corrupt coefficients cannot overflow it)
+			const int dc = std::max( -8192,std::min( pCoefs[0] * int( pQuant[0] ),8191 ) );
+			if( std::all_of( pCoefs + 1,pCoefs + 64,[]( short c ) { return c == 0; } ) )
+			{
+				// flat block, same result as running both passes on just the dc term
+				const unsigned char value = Clamp8( (dc * 4 * 4096 + 65536 + (128 << 17)) >> 17 );
+				for( unsigned int y = 0u; y < 8u; y++,pOut += outPitch )
+				{
+					std::fill_n( pOut,8u,value );
+				}
+				return;
+			}
+			int dequant[64];
+			for( unsigned int i = 0u; i < 64u; i++ )
+			{
+				dequant[i] = std::max( -8192,std::min( pCoefs[i] * int( pQuant[i] ),8191 ) );
+			}
+			// columns, keeping 2 extra bits of precision
+			int tmp[64];
+			for( unsigned int x = 0u; x < 8u; x++ )
+			{
+				const int* d = dequant + x;
+				int* t = tmp + x;
+				if( !(d[8] | d[16] | d[24] | d[32] | d[40] | d[48] | d[56]) )
+				{
+					// only the dc term, the whole column is flat
+					const int dcTerm = d[0] * 4;
+					for( unsigned int y = 0u; y < 8u; y++ )
+					{
+						t[y * 8u] = dcTerm;
+					}
+					continue;
+				}
+				const Idct1D<int> f( d[0],d[8],d[16],d[24],d[32],d[40],d[48],d[56] );
+				const int bias = 512;
+				t[0] = (f.x0 + bias + f.t3) >> 10;
+				t[56] = (f.x0 + bias - f.t3) >> 10;
+				t[8] = (f.x1 + bias + f.t2) >> 10;
+				t[48] = (f.x1 + bias - f.t2) >> 10;
+				t[16] = (f.x2 + bias + f.t1) >> 10;
+				t[40] = (f.x2 + bias - f.t1) >> 10;
+				t[24] = (f.x3 + bias + f.t0) >> 10;
+				t[32] = (f.x3 + bias - f.t0) >> 10;
+			}
+			// rows, removing the 12 bit constants, the 2 extra bits and the 8x scale of the
+			// two passes (17 bits), rounding and adding the 128 level shift before the shift
+			for( unsigned int y = 0u; y < 8u; y++,pOut += outPitch )
+			{
+				const int* t = tmp + y * 8u;
+				const Idct1D<int64_t> f( t[0],t[1],t[2],t[3],t[4],t[5],t[6],t[7] );
+				const int64_t bias = 65536 + (128 << 17);
+				pOut[0] = Clamp8( (f.x0 + bias + f.t3) >> 17 );
+				pOut[7] = Clamp8( (f.x0 + bias - f.t3) >> 17 );
+				pOut[1] = Clamp8( (f.x1 + bias + f.t2) >> 17 );
+				pOut[6] = Clamp8( (f.x1 + bias - f.t2) >> 17 );
+				pOut[2] = Clamp8( (f.x2 + bias + f.t1) >> 17 );
+				pOut[5] = Clamp8( (f.x2 + bias - f.t1) >> 17 );
+				pOut[3] = Clamp8( (f.x3 + bias + f.t0) >> 17 );
+				pOut[4] = Clamp8( (f.x3 + bias - f.t0) >> 17 );
+			}
+		}
+		// inverse transforms every component and writes color converted rows to pDst
+		void Output( Color* pDst,unsigned int pitch ) const
+		{
+			std::vector<std::vector<unsigned char>> planes( components.size() );
+			std::vector<unsigned int> planePitches( components.size() );
+			// source column of every output pixel for subsampled components
+			std::vector<std::vector<unsigned int>> columns( components.size() );
+			for( size_t i = 0u; i < components.size(); i++ )
+			{
+				const Component& c = components[i];
+				planePitches[i] = c.blocksPerLine * 8u;
+				planes[i].resize( size_t( planePitches[i] ) * c.blocksPerColumn * 8u );
+				for( unsigned int by = 0u; by < c.usedBlocksPerColumn; by++ )
+				{
+					for( unsigned int bx = 0u; bx < c.usedBlocksPerLine; bx++ )
+					{
+						TransformBlock( &c.coefs[(size_t( by ) * c.blocksPerLine + bx) * 64u],quant[c.quantTable],
+							&planes[i][size_t( by ) * 8u * planePitches[i] + bx * 8u],planePitches[i] );
+					}
+				}
+				if( c.h != hMax )
+				{
+					columns[i].resize( width );
+					for( unsigned int x = 0u; x < width; x++ )
+					{
+						columns[i][x] = x * c.h / hMax;
+					}
+				}
+			}
+
+			std::vector<unsigned char> upsampled( size_t( width ) * components.size() );
+			// component ids 'R','G','B' or the adobe marker say there is no ycbcr transform
+			const bool rgb = components.size() == 3u && (adobeTransform == 0 ||
+				(components[0].id == 'R' && components[1].id == 'G' && components[2].id == 'B'));
+			for( unsigned int y = 0u; y < height; y++ )
+			{
+				const unsigned char* rows[3];
+				for( size_t i = 0u; i < components.size(); i++ )
+				{
+					const Component& c = components[i];
+					const unsigned char* pRow = &planes[i][size_t( y * c.v / vMax ) * planePitches[i]];
+					if( c.h != hMax )
+					{
+						unsigned char* const pUp = &upsampled[i * width];
+						for( unsigned int x = 0u; x < width; x++ )
+						{
+							pUp[x] = pRow[columns[i][x]];
+						}
+						pRow = pUp;
+					}
+					rows[i] = pRow;
+				}
+				Color* const pOut = pDst + size_t( y ) * pitch;
+				if( components.size() == 1u )
+				{
+					for( unsigned int x = 0u; x < width; x++ )
+					{
+						const unsigned char g = rows[0][x];
+						pOut[x] = Color( 255u,g,g,g );
+					}
+				}
+				else if( rgb )
+				{
+					for( unsigned int x = 0u; x < width; x++ )
+					{
+						pOut[x] = Color( 255u,rows[0][x],rows[1][x],rows[2][x] );
+					}
+				}
+				else
+				{
+					// jfif ycbcr to rgb in 16 bit fixed point
+					// (branch free so the loop vectorizes)
+					const unsigned char* const pY = rows[0];
+					const unsigned char* const pCb = rows[1];
+					const unsigned char* const pCr = rows[2];
+					for( unsigned int x = 0u; x < width; x++ )
+					{
+						const int luma = (pY[x] << 16) + (1 << 15);
+						const int cb = pCb[x] - 128;
+						const int cr = pCr[x] - 128;
+						const int r = std::min( std::max( (luma + 91881 * cr) >> 16,0 ),255 );
+						const int g = std::min( std::max( (luma - 22554 * cb - 46802 * cr) >> 16,0 ),255 );
+						const int b = std::min( std::max( (luma + 116130 * cb) >> 16,0 ),255 );
+						pOut[x] = Color( 0xFF000000u | (unsigned int)( (r << 16) | (g << 8) | b ) );
+					}
+				}
+			}
+		}
+	private:
+		// natural order index of each zigzag position
+		static constexpr unsigned char zigzag[64] = {
+			0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,
+			35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63
+		};
+		const unsigned char* pData;
+		size_t size;
+		unsigned int width = 0u;
+		unsigned int height = 0u;
+		bool progressive = false;
+		unsigned int hMax = 1u;
+		unsigned int vMax = 1u;
+		unsigned int mcusPerLine = 0u;
+		unsigned int mcusPerColumn = 0u;
+		unsigned int restartInterval = 0u;
+		int adobeTransform = -1;
+		std::vector<Component> components;
+		uint16_t quant[4][64] = {};
+		Huffman dc[4];
+		Huffman ac[4];
+		// current scan
+		unsigned int spectralStart = 0u;
+		unsigned int spectralEnd = 63u;
+		unsigned int approxHigh = 0u;
+		unsigned int approxLow = 0u;
+		unsigned int eobRun = 0u;
+		// entropy decoder state (msb first bit buffer)
+		const unsigned char* pBits = nullptr;
+		uint32_t bitBuf = 0u;
+		unsigned int bitCount = 0u;
+		bool hitMarker = false;
+	};
+	constexpr unsigned char JpegDecoder::zigzag[64];
+
+	class BmpDecoder
+	{
+	public:
+		BmpDecoder( const unsigned char* pData,size_t size )
+			:
+			pData( pData ),
+			size( size )
+		{
+			if( size < 26u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"BMP header truncated." );
+			}
+			dataOffset = ReadLE32( pData + 10u );
+			const uint32_t infoSize = ReadLE32( pData + 14u );
+			if( infoSize < 12u || size < 14u + size_t( infoSize ) )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"BMP header truncated." );
+			}
+			int32_t signedHeight;
+			size_t paletteEntrySize = 4u;
+			unsigned int compression = 0u;
+			unsigned int nColorsUsed = 0u;
+			if( infoSize == 12u )
+			{
+				// os/2 core header
+				width = ReadLE16( pData + 18u );
+				signedHeight = int16_t( ReadLE16( pData + 20u ) );
+				bitCount = ReadLE16( pData + 24u );
+				paletteEntrySize = 3u;
+			}
+			else
+			{
+				if( infoSize < 40u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Unknown BMP header." );
+				}
+				const int32_t signedWidth = int32_t( ReadLE32( pData + 18u ) );
+				signedHeight = int32_t( ReadLE32( pData + 22u ) );
+				bitCount = ReadLE16( pData + 28u );
+				compression = ReadLE32( pData + 30u );
+				nColorsUsed = ReadLE32( pData + 46u );
+				if( signedWidth <= 0 )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Image dimensions out of range." );
+				}
+				width = (unsigned int)( signedWidth );
+			}
+			topDown = signedHeight < 0;
+			height = (unsigned int)( topDown ? -int64_t( signedHeight ) : signedHeight );
+			CheckDimensions( width,height );
+
+			// 0 = rgb, 3 = bitfields, 6 = bitfields with alpha
+			size_t palettePos = 14u + infoSize;
+			if( compression == 3u || compression == 6u )
+			{
+				if( bitCount != 16u && bitCount != 32u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"Bad BMP bitfields." );
+				}
+				// the masks follow a plain info header, bigger headers contain them
+				const size_t maskPos = 54u;
+				const size_t nMasks = (compression == 6u || infoSize >= 56u) ? 4u : 3u;
+				if( size < maskPos + nMasks * 4u )
+				{
+					throw IMAGE_DECODER_EXCEPTION( L"BMP header truncated." );
+				}
+				for( size_t i = 0u; i < nMasks; i++ )
+				{
+					masks[i] = ReadLE32( pData + maskPos + i * 4u );
+				}
+				if( infoSize == 40u )
+				{
+					palettePos += (compression == 6u ? 16u : 12u);
+				}
+			}
+			else if( compression != 0u )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Compressed BMPs are not supported." );
+			}
+			else if( bitCount == 16u )
+			{
+				masks[0] = 0x7C00u;
+				masks[1] = 0x03E0u;
+				masks[2] = 0x001Fu;
+			}
+			else if( bitCount == 24u || bitCount == 32u )
+			{
+				// the fourth byte of 32 bit rgb is unused, the image is opaque
+				masks[0] = 0xFF0000u;
+				masks[1] = 0x00FF00u;
+				masks[2] = 0x0000FFu;
+			}
+			else if( bitCount == 1u || bitCount == 4u || bitCount == 8u )
+			{
+				const size_t nEntries = std::min( nColorsUsed ? size_t( nColorsUsed ) : (size_t( 1u ) << bitCount),size_t( 256u ) );
+				for( size_t i = 0u; i < nEntries && palettePos + (i + 1u) * paletteEntrySize <= size; i++ )
+				{
+					const unsigned char* p = pData + palettePos + i * paletteEntrySize;
+					palette[i] = Color( 255u,p[2],p[1],p[0] );
+				}
+			}
+			else
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"Bad BMP bit count." );
+			}
+
+			rowBytes = (size_t( width ) * bitCount + 31u) / 32u * 4u;
+			if( dataOffset > size || rowBytes * height > size - dataOffset )
+			{
+				throw IMAGE_DECODER_EXCEPTION( L"BMP pixel data truncated." );
+			}
+		}
+		unsigned int GetWidth() const
+		{
+			return width;
+		}
+		unsigned int GetHeight() const
+		{
+			return height;
+		}
+		void Decode( Color* pDst,unsigned int pitch ) const
+		{
+			class Channel
+			{
+			public:
+				Channel( uint32_t mask )
+					:
+					mask( mask )
+				{
+					if( mask == 0u )
+					{
+						return;
+					}
+					for( ; !((mask >> shift) & 1u); shift++ );
+					max = mask >> shift;
+				}
+				unsigned char Get( uint32_t pixel ) const
+				{
+					return (unsigned char)(((pixel & mask) >> shift) * 255u / max);
+				}
+				uint32_t mask;
+				unsigned int shift = 0u;
+				uint32_t max = 1u;
+			};
+			const Channel r( masks[0] );
+			const Channel g( masks[1] );
+			const Channel b( masks[2] );
+			const Channel a( masks[3] );
+			const unsigned int bytesPerPixel = bitCount / 8u;
+			for( unsigned int y = 0u; y < height; y++ )
+			{
+				// rows are stored bottom-up unless the height was negative
+				const unsigned char* pRow = pData + dataOffset + rowBytes * (topDown ? y : height - 1u - y);
+				Color* const pOut = pDst + size_t( y ) * pitch;
+				if( bitCount <= 8u )
+				{
+					const unsigned int mask = (1u << bitCount) - 1u;
+					for( unsigned int x = 0u; x < width; x++ )
+					{
+						const unsigned int bit = x * bitCount;
+						pOut[x] = palette[(pRow[bit / 8u] >> (8u - bitCount - bit % 8u)) & mask];
+					}
+				}
+				else if( bitCount == 24u || (bitCount == 32u && masks[0] == 0xFF0000u && masks[1] == 0x00FF00u &&
+					masks[2] == 0x0000FFu && (masks[3] == 0u || masks[3] == 0xFF000000u)) )
+				{
+					// plain bgr(a) bytes
+					const bool alpha = bitCount == 32u && masks[3] != 0u;
+					for( unsigned int x = 0u; x < width; x++,pRow += bytesPerPixel )
+					{
+						pOut[x] = Color( alpha ? pRow[3] : 255u,pRow[2],pRow[1],pRow[0] );
+					}
+				}
+				else
+				{
+					for( unsigned int x = 0u; x < width; x++,pRow += bytesPerPixel )
+					{
+						const uint32_t pixel = bitCount == 16u ? ReadLE16( pRow ) : ReadLE32( pRow );
+						pOut[x] = Color( masks[3] ? a.Get( pixel ) : 255u,r.Get( pixel ),g.Get( pixel ),b.Get( pixel ) );
+					}
+				}
+			}
+		}
+	private:
+		const unsigned char* pData;
+		size_t size;
+		unsigned int width = 0u;
+		unsigned int height = 0u;
+		unsigned int bitCount = 0u;
+		bool topDown = false;
+		size_t dataOffset = 0u;
+		size_t rowBytes = 0u;
+		// red, green, blue, alpha
+		uint32_t masks[4] = {};
+		// unused entries stay opaque black
+		Color palette[256] = {};
+	};
+}
+
+ImageDecoder::ImageDecoder( const unsigned char* pData,size_t size )
+	:
+	pData( pData ),
+	size( size ),
+	format( Identify( pData,size ) )
+{
+	switch( format )
+	{
+	case Format::Png:
+	{
+		const PngDecoder decoder( pData,size );
+		width = decoder.GetWidth();
+		height = decoder.GetHeight();
+		break;
+	}
+	case Format::Jpeg:
+	{
+		const JpegDecoder decoder( pData,size );
+		width = decoder.GetWidth();
+		height = decoder.GetHeight();
+		break;
+	}
+	case Format::Bmp:
+	{
+		const BmpDecoder decoder( pData,size );
+		width = decoder.GetWidth();
+		height = decoder.GetHeight();
+		break;
+	}
+	default:
+		throw IMAGE_DECODER_EXCEPTION( L"Unknown image format." );
+	}
+}
+
+ImageDecoder::Format ImageDecoder::Identify( const unsigned char* pData,size_t size )
+{
+	if( size >= 8u && !memcmp( pData,"\x89PNG\r\n\x1A\n",8 ) )
+	{
+		return Format::Png;
+	}
+	if( size >= 3u && pData[0] == 0xFFu && pData[1] == 0xD8u && pData[2] == 0xFFu )
+	{
+		return Format::Jpeg;
+	}
+	if( size >= 2u && pData[0] == 'B' && pData[1] == 'M' )
+	{
+		return Format::Bmp;
+	}
+	return Format::Unknown;
+}
+
+ImageDecoder::Format ImageDecoder::GetFormat() const
+{
+	return format;
+}
+
+unsigned int ImageDecoder::GetWidth() const
+{
+	return width;
+}
+
+unsigned int ImageDecoder::GetHeight() const
+{
+	return height;
+}
+
+void ImageDecoder::Decode( Color* pDst,unsigned int pitch ) const
+{
+	assert( pitch >= width );
+	switch( format )
+	{
+	case Format::Png:
+		PngDecoder( pData,size ).Decode( pDst,pitch );
+		break;
+	case Format::Jpeg:
+		JpegDecoder( pData,size ).Decode( pDst,pitch );
+		break;
+	case Format::Bmp:
+		BmpDecoder( pData,size ).Decode( pDst,pitch );
+		break;
+	default:
+		break;
+	}
+}
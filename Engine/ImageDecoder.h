@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Colors.h"
+#include "ChiliException.h"
+
+// decodes PNG, JPEG and BMP images from memory without any os support
+// rows are written straight into a caller supplied pixel buffer (alpha is 255 for opaque formats)
+// supported: PNG of any color type / bit depth, interlaced or not
+//            JPEG baseline and progressive, grayscale or YCbCr, any chroma subsampling
+//            BMP uncompressed 1/4/8/16/24/32 bpp, top-down or bottom-up
+class ImageDecoder
+{
+public:
+	class Exception : public ChiliException
+	{
+	public:
+		using ChiliException::ChiliException;
+		virtual std::wstring GetFullMessage() const override { return GetNote() + L"\nAt: " + GetLocation(); }
+		virtual std::wstring GetExceptionType() const override { return L"Image Decoder Exception"; }
+	};
+	enum class Format
+	{
+		Unknown,
+		Png,
+		Jpeg,
+		Bmp
+	};
+public:
+	// reads the header (the data is not copied, it must outlive the decoder)
+	ImageDecoder( const unsigned char* pData,size_t size );
+	// tells the format from the file signature
+	static Format Identify( const unsigned char* pData,size_t size );
+	Format GetFormat() const;
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	// decodes the image into the width x height pixels at pDst (pitch is in pixels)
+	void Decode( Color* pDst,unsigned int pitch ) const;
+private:
+	const unsigned char* pData;
+	size_t size;
+	Format format;
+	unsigned int width = 0u;
+	unsigned int height = 0u;
+};
@@ -0,0 +1,406 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+	void PutBE32( unsigned char* p,uint32_t v )
+	{
+		p[0] = (unsigned char)( v >> 24 );
+		p[1] = (unsigned char)( v >> 16 );
+		p[2] = (unsigned char)( v >> 8 );
+		p[3] = (unsigned char)( v );
+	}
+
+	struct CrcTable
+	{
+		CrcTable()
+		{
+			for( uint32_t n = 0u; n < 256u; n++ )
+			{
+				uint32_t c = n;
+				for( int k = 0; k < 8; k++ )
+				{
+					c = (c & 1u) ? 0xEDB88320u ^ (c >> 1u) : c >> 1u;
+				}
+				entries[n] = c;
+			}
+		}
+		uint32_t entries[256];
+	};
+	const CrcTable crcTable;
+
+	uint32_t Crc32( const unsigned char* p,size_t n )
+	{
+		uint32_t crc = 0xFFFFFFFFu;
+		for( size_t i = 0u; i < n; i++ )
+		{
+			crc = crcTable.entries[(crc ^ p[i]) & 0xFFu] ^ (crc >> 8u);
+		}
+		return ~crc;
+	}
+	uint32_t Adler32( const unsigned char* p,size_t n )
+	{
+		uint32_t a = 1u;
+		uint32_t b = 0u;
+		while( n > 0u )
+		{
+			// largest run that cannot overflow b before the modulo
+			size_t run = std::min( n,size_t( 5552u ) );
+			n -= run;
+			for( ; run > 0u; run-- )
+			{
+				a += *p++;
+				b += a;
+			}
+			a %= 65521u;
+			b %= 65521u;
+		}
+		return (b << 16u) | a;
+	}
+
+	// deflate's fixed huffman codes, with the extra bits of every length and distance folded in
+	// (huffman codes go out msb first, so they are stored bit reversed)
+	struct DeflateTables
+	{
+		DeflateTables()
+		{
+			for( unsigned int sym = 0u; sym < 288u; sym++ )
+			{
+				if( sym < 144u )
+				{
+					SetCode( sym,0x30u + sym,8u );
+				}
+				else if( sym < 256u )
+				{
+					SetCode( sym,0x190u + sym - 144u,9u );
+				}
+				else if( sym < 280u )
+				{
+					SetCode( sym,sym - 256u,7u );
+				}
+				else
+				{
+					SetCode( sym,0xC0u + sym - 280u,8u );
+				}
+			}
+			static const unsigned short lengthBase[29] = {
+				3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+			static const unsigned char lengthExtra[29] = {
+				0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+			for( unsigned int c = 0u; c < 29u; c++ )
+			{
+				const unsigned int end = c == 28u ? 259u : lengthBase[c + 1u];
+				for( unsigned int len = lengthBase[c]; len < end; len++ )
+				{
+					const unsigned int sym = 257u + c;
+					lengthCodes[len] = litCodes[sym] | ((len - lengthBase[c]) << litBits[sym]);
+					lengthBits[len] = (unsigned char)( litBits[sym] + lengthExtra[c] );
+				}
+			}
+			static const unsigned short distBase[30] = {
+				1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+				1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+			for( unsigned int c = 0u; c < 30u; c++ )
+			{
+				distBases[c] = distBase[c];
+				distExtra[c] = (unsigned char)( c < 4u ? 0u : c / 2u - 1u );
+				distCodes[c] = Reverse( c,5u );
+				for( unsigned int d = distBase[c]; d < distBase[c] + (1u << distExtra[c]); d++ )
+				{
+					distIndex[GetDistSlot( d )] = (unsigned char)c;
+				}
+			}
+		}
+		// slot of a distance in distIndex (exact below 257, in steps of 128 above)
+		static unsigned int GetDistSlot( unsigned int dist )
+		{
+			return dist <= 256u ? dist - 1u : 256u + ((dist - 1u) >> 7u);
+		}
+		static uint32_t Reverse( uint32_t code,unsigned int nBits )
+		{
+			uint32_t reversed = 0u;
+			for( unsigned int i = 0u; i < nBits; i++ )
+			{
+				reversed |= ((code >> i) & 1u) << (nBits - 1u - i);
+			}
+			return reversed;
+		}
+		void SetCode( unsigned int sym,uint32_t code,unsigned int nBits )
+		{
+			litCodes[sym] = Reverse( code,nBits );
+			litBits[sym] = (unsigned char)nBits;
+		}
+		uint32_t litCodes[288];
+		unsigned char litBits[288];
+		uint32_t lengthCodes[259];
+		unsigned char lengthBits[259];
+		uint32_t distCodes[30];
+		unsigned short distBases[30];
+		unsigned char distExtra[30];
+		unsigned char distIndex[512];
+	};
+	const DeflateTables deflateTables;
+
+	class BitWriter
+	{
+	public:
+		BitWriter( unsigned char* pDst )
+			:
+			pDst( pDst )
+		{}
+		// nBits <= 32
+		void Put( uint32_t code,unsigned int nBits )
+		{
+			bits |= uint64_t( code ) << count;
+			count += nBits;
+			if( count >= 32u )
+			{
+				pDst[0] = (unsigned char)( bits );
+				pDst[1] = (unsigned char)( bits >> 8u );
+				pDst[2] = (unsigned char)( bits >> 16u );
+				pDst[3] = (unsigned char)( bits >> 24u );
+				pDst += 4;
+				bits >>= 32u;
+				count -= 32u;
+			}
+		}
+		// pads the last byte, returns the end of the output
+		unsigned char* Finish()
+		{
+			for( ; count > 0u; count = count > 8u ? count - 8u : 0u )
+			{
+				*pDst++ = (unsigned char)( bits );
+				bits >>= 8u;
+			}
+			return pDst;
+		}
+	private:
+		unsigned char* pDst;
+		uint64_t bits = 0u;
+		unsigned int count = 0u;
+	};
+
+	// worst case size of Deflate's output (no match codes more than 9 bits per byte)
+	size_t GetDeflateBound( size_t size )
+	{
+		return size + size / 8u + 16u;
+	}
+	// one final block with the fixed codes
+	// each position probes only the last position with the same 3 byte hash, which is plenty
+	// for rendered frames (flat runs and repeated rows become long matches after filtering)
+	unsigned char* Deflate( const unsigned char* pSrc,size_t size,unsigned char* pDst,std::vector<uint32_t>& head )
+	{
+		constexpr unsigned int HashBits = 15u;
+		constexpr size_t WindowSize = 32768u;
+		constexpr size_t MaxMatch = 258u;
+		// positions are stored + 1, 0 is empty
+		head.assign( size_t( 1u ) << HashBits,0u );
+		const DeflateTables& t = deflateTables;
+
+		BitWriter writer( pDst );
+		// final block, fixed huffman codes
+		writer.Put( 1u,1u );
+		writer.Put( 1u,2u );
+		size_t i = 0u;
+		while( i + 3u <= size )
+		{
+			const uint32_t key = (uint32_t( pSrc[i] ) << 16u) | (uint32_t( pSrc[i + 1u] ) << 8u) | pSrc[i + 2u];
+			const uint32_t hash = (key * 2654435761u) >> (32u - HashBits);
+			const size_t candidate = head[hash];
+			head[hash] = uint32_t( i + 1u );
+			if( candidate != 0u && i - (candidate - 1u) <= WindowSize &&
+				pSrc[candidate - 1u] == pSrc[i] && pSrc[candidate] == pSrc[i + 1u] && pSrc[candidate + 1u] == pSrc[i + 2u] )
+			{
+				const size_t match = candidate - 1u;
+				const size_t maxLen = std::min( size - i,MaxMatch );
+				size_t len = 3u;
+				while( len < maxLen && pSrc[match + len] == pSrc[i + len] )
+				{
+					len++;
+				}
+				const unsigned int dist = (unsigned int)( i - match );
+				const unsigned int c = t.distIndex[DeflateTables::GetDistSlot( dist )];
+				writer.Put( t.lengthCodes[len],t.lengthBits[len] );
+				writer.Put( t.distCodes[c] | ((dist - t.distBases[c]) << 5u),5u + t.distExtra[c] );
+				i += len;
+			}
+			else
+			{
+				writer.Put( t.litCodes[pSrc[i]],t.litBits[pSrc[i]] );
+				i++;
+			}
+		}
+		for( ; i < size; i++ )
+		{
+			writer.Put( t.litCodes[pSrc[i]],t.litBits[pSrc[i]] );
+		}
+		// end of block
+		writer.Put( t.litCodes[256],t.litBits[256] );
+		return writer.Finish();
+	}
+
+	unsigned char* PutChunk( unsigned char* p,const char* type,size_t dataSize )
+	{
+		// data is expected to be in place already, after the length and type
+		PutBE32( p,uint32_t( dataSize ) );
+		std::memcpy( p + 4,type,4u );
+		PutBE32( p + 8 + dataSize,Crc32( p + 4,dataSize + 4u ) );
+		return p + 12 + dataSize;
+	}
+	size_t SumAbs( const unsigned char* p,size_t n )
+	{
+		size_t sum = 0u;
+		for( size_t i = 0u; i < n; i++ )
+		{
+			sum += (size_t)std::abs( (int)(signed char)p[i] );
+		}
+		return sum;
+	}
+}
+
+void ImageEncoder::EncodePng( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+	std::vector<unsigned char>& out )
+{
+	// scratch of the calling thread, kept from frame to frame
+	thread_local std::vector<unsigned char> filtered;
+	thread_local std::vector<unsigned char> rows;
+	thread_local std::vector<unsigned char> sub;
+	thread_local std::vector<uint32_t> head;
+
+	// filter each row (filter type byte + rgb residuals)
+	const size_t rgbSize = size_t( width ) * 3u;
+	const size_t rowSize = rgbSize + 1u;
+	filtered.resize( rowSize * height );
+	rows.assign( rgbSize * 2u,0u );
+	unsigned char* pPrev = rows.data();
+	unsigned char* pCur = rows.data() + rgbSize;
+	sub.resize( rgbSize );
+	for( unsigned int y = 0u; y < height; y++ )
+	{
+		const Color* pRow = pSrc + size_t( y ) * pitch;
+		for( unsigned int x = 0u; x < width; x++ )
+		{
+			pCur[x * 3u] = pRow[x].GetR();
+			pCur[x * 3u + 1u] = pRow[x].GetG();
+			pCur[x * 3u + 2u] = pRow[x].GetB();
+		}
+		unsigned char* pOut = &filtered[rowSize * y];
+		for( size_t i = 0u; i < std::min( rgbSize,size_t( 3u ) ); i++ )
+		{
+			sub[i] = pCur[i];
+		}
+		for( size_t i = 3u; i < rgbSize; i++ )
+		{
+			sub[i] = (unsigned char)( pCur[i] - pCur[i - 3u] );
+		}
+		// up is only worth checking against a real row above
+		for( size_t i = 0u; i < rgbSize && y > 0u; i++ )
+		{
+			pOut[1u + i] = (unsigned char)( pCur[i] - pPrev[i] );
+		}
+		if( y > 0u && SumAbs( pOut + 1,rgbSize ) < SumAbs( sub.data(),rgbSize ) )
+		{
+			pOut[0] = 2u;
+		}
+		else
+		{
+			pOut[0] = 1u;
+			std::copy( sub.begin(),sub.end(),pOut + 1 );
+		}
+		std::swap( pPrev,pCur );
+	}
+
+	// signature, IHDR, IDAT (zlib stream), IEND
+	static const unsigned char signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+	out.resize( 8u + 25u + 12u + 2u + GetDeflateBound( filtered.size() ) + 4u + 12u );
+	unsigned char* p = out.data();
+	std::memcpy( p,signature,8u );
+	p += 8;
+	PutBE32( p + 8,width );
+	PutBE32( p + 12,height );
+	// 8 bits per channel, rgb, deflate, adaptive filtering, no interlace
+	p[16] = 8u;
+	p[17] = 2u;
+	p[18] = 0u;
+	p[19] = 0u;
+	p[20] = 0u;
+	p = PutChunk( p,"IHDR",13u );
+	unsigned char* const pData = p + 8;
+	// zlib header: deflate with a 32k window, fastest compression level
+	pData[0] = 0x78u;
+	pData[1] = 0x01u;
+	unsigned char* pEnd = Deflate( filtered.data(),filtered.size(),pData + 2,head );
+	PutBE32( pEnd,Adler32( filtered.data(),filtered.size() ) );
+	pEnd += 4;
+	p = PutChunk( p,"IDAT",size_t( pEnd - pData ) );
+	p = PutChunk( p,"IEND",0u );
+	out.resize( size_t( p - out.data() ) );
+}
+
+void ImageEncoder::EncodePpm( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+	std::vector<unsigned char>& out )
+{
+	char header[32];
+	const int headerSize = std::snprintf( header,sizeof( header ),"P6\n%u %u\n255\n",width,height );
+	out.resize( size_t( headerSize ) + size_t( width ) * height * 3u );
+	std::memcpy( out.data(),header,size_t( headerSize ) );
+	unsigned char* p = out.data() + headerSize;
+	for( unsigned int y = 0u; y < height; y++ )
+	{
+		const Color* pRow = pSrc + size_t( y ) * pitch;
+		for( unsigned int x = 0u; x < width; x++ )
+		{
+			p[0] = pRow[x].GetR();
+			p[1] = pRow[x].GetG();
+			p[2] = pRow[x].GetB();
+			p += 3;
+		}
+	}
+}
+
+void ImageEncoder::EncodeYuv420( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+	std::vector<unsigned char>& out )
+{
+	const unsigned int chromaWidth = (width + 1u) / 2u;
+	const unsigned int chromaHeight = (height + 1u) / 2u;
+	const size_t lumaSize = size_t( width ) * height;
+	const size_t chromaSize = size_t( chromaWidth ) * chromaHeight;
+	out.resize( lumaSize + chromaSize * 2u );
+	unsigned char* const pY = out.data();
+	unsigned char* const pU = pY + lumaSize;
+	unsigned char* const pV = pU + chromaSize;
+	// bt.601 in 8 bit fixed point
+	for( unsigned int y = 0u; y < height; y++ )
+	{
+		const Color* pRow = pSrc + size_t( y ) * pitch;
+		unsigned char* pOut = pY + size_t( y ) * width;
+		for( unsigned int x = 0u; x < width; x++ )
+		{
+			const int r = pRow[x].GetR();
+			const int g = pRow[x].GetG();
+			const int b = pRow[x].GetB();
+			pOut[x] = (unsigned char)( ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16 );
+		}
+	}
+	for( unsigned int cy = 0u; cy < chromaHeight; cy++ )
+	{
+		// odd sizes repeat the last row / column
+		const Color* pRow0 = pSrc + size_t( cy * 2u ) * pitch;
+		const Color* pRow1 = pSrc + size_t( std::min( cy * 2u + 1u,height - 1u ) ) * pitch;
+		for( unsigned int cx = 0u; cx < chromaWidth; cx++ )
+		{
+			const unsigned int x0 = cx * 2u;
+			const unsigned int x1 = std::min( x0 + 1u,width - 1u );
+			const int r = pRow0[x0].GetR() + pRow0[x1].GetR() + pRow1[x0].GetR() + pRow1[x1].GetR();
+			const int g = pRow0[x0].GetG() + pRow0[x1].GetG() + pRow1[x0].GetG() + pRow1[x1].GetG();
+			const int b = pRow0[x0].GetB() + pRow0[x1].GetB() + pRow1[x0].GetB() + pRow1[x1].GetB();
+			// sums of 4, so 2 more bits to shift off
+			pU[size_t( cy ) * chromaWidth + cx] = (unsigned char)( ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128 );
+			pV[size_t( cy ) * chromaWidth + cx] = (unsigned char)( ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128 );
+		}
+	}
+}
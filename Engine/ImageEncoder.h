@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Colors.h"
+#include <vector>
+
+// encodes pixels into image files in memory without any os support (alpha is dropped)
+// the output vector is reused, so encoding a sequence of frames does not allocate per frame
+class ImageEncoder
+{
+public:
+	// 8 bit rgb png, each row gets the sub or up filter (whichever leaves smaller residuals)
+	// and is deflated with the fixed huffman codes and a single probe lz77 match finder
+	static void EncodePng( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+		std::vector<unsigned char>& out );
+	// binary ppm (P6)
+	static void EncodePpm( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+		std::vector<unsigned char>& out );
+	// planar 4:2:0 frame for a y4m stream (bt.601 studio range, chroma averaged over 2x2 pixels)
+	static void EncodeYuv420( const Color* pSrc,unsigned int pitch,unsigned int width,unsigned int height,
+		std::vector<unsigned char>& out );
+};
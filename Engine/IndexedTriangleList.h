@@ -1,20 +1,60 @@
 #pragma once
 
 #include <vector>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 #include "Vec3.h"
+#include "PositionStream.h"
 
-template<class T>
+// vertices + index triples, I is the index type (16 bit is plenty for most models)
+template<class T,class I = uint16_t>
 class IndexedTriangleList
 {
+	static_assert( std::is_same<I,uint16_t>::value || std::is_same<I,uint32_t>::value,
+		"indices must be uint16_t or uint32_t" );
 public:
-	IndexedTriangleList( std::vector<T> verts_in,std::vector<size_t> indices_in )
+	typedef I Index;
+public:
+	IndexedTriangleList( std::vector<T> verts_in,std::vector<I> indices_in )
 		:
+		indices( std::move( indices_in ) ),
 		vertices( std::move( verts_in ) ),
-		indices( std::move( indices_in ) )
+		positions( vertices )
 	{
 		assert( vertices.size() > 2 );
 		assert( indices.size() % 3 == 0 );
+		assert( vertices.size() - 1u <= size_t( std::numeric_limits<I>::max() ) );
+	}
+	const std::vector<T>& GetVertices() const
+	{
+		return vertices;
+	}
+	// vertices are only changed through here, so the position stream never goes stale
+	// f gets the vertex vector, the positions are copied out again after it returns
+	template<class F>
+	void EditVertices( F f )
+	{
+		f( vertices );
+		assert( vertices.size() - 1u <= size_t( std::numeric_limits<I>::max() ) );
+		positions.Assign( vertices );
+		revision++;
 	}
+	// counts the EditVertices calls (tells an edited list from one that is unchanged)
+	unsigned int GetRevision() const
+	{
+		return revision;
+	}
+	// copy of the vertex positions for the vertex stage
+	const PositionStream& GetPositions() const
+	{
+		return positions;
+	}
+public:
+	std::vector<I> indices;
+private:
 	std::vector<T> vertices;
-	std::vector<size_t> indices;
-};
\ No newline at end of file
+	PositionStream positions;
+	unsigned int revision = 0u;
+};
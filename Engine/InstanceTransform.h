@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Mat3.h"
+
+// placement of one instance of a mesh for Pipeline::DrawInstanced
+// effects derive from this to add per instance attributes, Apply() is
+// called on every vertex of the instance after it has been transformed
+class InstanceTransform
+{
+public:
+	template<class Vertex>
+	void Apply( Vertex& ) const
+	{}
+public:
+	Mat3 rotation;
+	Vec3 translation;
+};
@@ -0,0 +1,255 @@
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "ChiliWin.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+#include "MappedFile.h"
+
+#ifndef _CRT_WIDE
+#define _CRT_WIDE_( s ) L ## s
+#define _CRT_WIDE( s ) _CRT_WIDE_( s )
+#endif
+
+#ifndef _WIN32
+namespace
+{
+	// wide file names are utf-32 here, the file system wants utf-8
+	std::string ToNativePath( const std::wstring& filename )
+	{
+		std::string narrow;
+		for( const wchar_t wc : filename )
+		{
+			const uint32_t c = uint32_t( wc );
+			if( c < 0x80u )
+			{
+				narrow += char( c );
+			}
+			else if( c < 0x800u )
+			{
+				narrow += char( 0xC0u | (c >> 6) );
+				narrow += char( 0x80u | (c & 0x3Fu) );
+			}
+			else if( c < 0x10000u )
+			{
+				narrow += char( 0xE0u | (c >> 12) );
+				narrow += char( 0x80u | ((c >> 6) & 0x3Fu) );
+				narrow += char( 0x80u | (c & 0x3Fu) );
+			}
+			else
+			{
+				narrow += char( 0xF0u | (c >> 18) );
+				narrow += char( 0x80u | ((c >> 12) & 0x3Fu) );
+				narrow += char( 0x80u | ((c >> 6) & 0x3Fu) );
+				narrow += char( 0x80u | (c & 0x3Fu) );
+			}
+		}
+		return narrow;
+	}
+}
+#endif
+
+MappedFile::MappedFile( const std::wstring& filename )
+{
+#ifdef _WIN32
+	hFile = CreateFileW( filename.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,
+		OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr );
+	if( hFile == INVALID_HANDLE_VALUE )
+	{
+		hFile = nullptr;
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to open." );
+	}
+	LARGE_INTEGER fileSize;
+	if( !GetFileSizeEx( hFile,&fileSize ) || uint64_t( fileSize.QuadPart ) > SIZE_MAX )
+	{
+		CloseHandle( hFile );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: bad file size." );
+	}
+	size = size_t( fileSize.QuadPart );
+	if( size == 0u )
+	{
+		return;
+	}
+	hMapping = CreateFileMappingW( hFile,nullptr,PAGE_READONLY,0u,0u,nullptr );
+	if( hMapping != nullptr )
+	{
+		pData = static_cast<unsigned char*>( MapViewOfFile( hMapping,FILE_MAP_READ,0u,0u,0u ) );
+	}
+	if( pData == nullptr )
+	{
+		if( hMapping != nullptr )
+		{
+			CloseHandle( hMapping );
+		}
+		CloseHandle( hFile );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to map." );
+	}
+#else
+	fd = open( ToNativePath( filename ).c_str(),O_RDONLY );
+	if( fd < 0 )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to open." );
+	}
+	struct stat info;
+	if( fstat( fd,&info ) != 0 || info.st_size < 0 )
+	{
+		close( fd );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: bad file size." );
+	}
+	size = size_t( info.st_size );
+	if( size == 0u )
+	{
+		return;
+	}
+	void* const pMapped = mmap( nullptr,size,PROT_READ,MAP_PRIVATE,fd,0 );
+	if( pMapped == MAP_FAILED )
+	{
+		close( fd );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to map." );
+	}
+	pData = static_cast<unsigned char*>( pMapped );
+#endif
+}
+
+MappedFile::MappedFile( const std::wstring& filename,size_t size_in )
+	:
+	size( size_in ),
+	writable( true )
+{
+#ifdef _WIN32
+	hFile = CreateFileW( filename.c_str(),GENERIC_READ | GENERIC_WRITE,0u,nullptr,
+		CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,nullptr );
+	if( hFile == INVALID_HANDLE_VALUE )
+	{
+		hFile = nullptr;
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to create." );
+	}
+	if( size == 0u )
+	{
+		return;
+	}
+	// the mapping extends the file to its size
+	const uint64_t size64 = uint64_t( size );
+	hMapping = CreateFileMappingW( hFile,nullptr,PAGE_READWRITE,DWORD( size64 >> 32 ),DWORD( size64 ),nullptr );
+	if( hMapping != nullptr )
+	{
+		pData = static_cast<unsigned char*>( MapViewOfFile( hMapping,FILE_MAP_WRITE,0u,0u,0u ) );
+	}
+	if( pData == nullptr )
+	{
+		if( hMapping != nullptr )
+		{
+			CloseHandle( hMapping );
+		}
+		CloseHandle( hFile );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to map." );
+	}
+#else
+	fd = open( ToNativePath( filename ).c_str(),O_RDWR | O_CREAT | O_TRUNC,0644 );
+	if( fd < 0 )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to create." );
+	}
+	if( size == 0u )
+	{
+		return;
+	}
+	void* pMapped = MAP_FAILED;
+	if( ftruncate( fd,off_t( size ) ) == 0 )
+	{
+		pMapped = mmap( nullptr,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0 );
+	}
+	if( pMapped == MAP_FAILED )
+	{
+		close( fd );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Mapping [" + filename + L"]: failed to map." );
+	}
+	pData = static_cast<unsigned char*>( pMapped );
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if( pData != nullptr )
+	{
+		UnmapViewOfFile( pData );
+	}
+	if( hMapping != nullptr )
+	{
+		CloseHandle( hMapping );
+	}
+	if( hFile != nullptr )
+	{
+		CloseHandle( hFile );
+	}
+#else
+	if( pData != nullptr )
+	{
+		munmap( pData,size );
+	}
+	if( fd >= 0 )
+	{
+		close( fd );
+	}
+#endif
+}
+
+const unsigned char* MappedFile::GetData() const
+{
+	return pData;
+}
+
+unsigned char* MappedFile::GetWritableData()
+{
+	return writable ? pData : nullptr;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return size;
+}
+
+void MappedFile::Replace( const std::wstring& from,const std::wstring& to )
+{
+#ifdef _WIN32
+	if( !MoveFileExW( from.c_str(),to.c_str(),MOVEFILE_REPLACE_EXISTING ) )
+	{
+		DeleteFileW( from.c_str() );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Replacing [" + to + L"]: failed to rename." );
+	}
+#else
+	const std::string nativeFrom = ToNativePath( from );
+	if( rename( nativeFrom.c_str(),ToNativePath( to ).c_str() ) != 0 )
+	{
+		unlink( nativeFrom.c_str() );
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Replacing [" + to + L"]: failed to rename." );
+	}
+#endif
+}
+
+bool MappedFile::GetFileInfo( const std::wstring& filename,uint64_t& size_out,int64_t& writeTime )
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if( _wstat64( filename.c_str(),&info ) != 0 )
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if( stat( ToNativePath( filename ).c_str(),&info ) != 0 )
+	{
+		return false;
+	}
+#endif
+	size_out = uint64_t( info.st_size );
+	writeTime = int64_t( info.st_mtime );
+	return true;
+}
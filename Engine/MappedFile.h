@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ChiliException.h"
+#include <string>
+#include <cstdint>
+
+// read-only memory mapping of a whole file
+// pages are read in by the os on first touch, nothing is copied up front
+class MappedFile
+{
+public:
+	class Exception : public ChiliException
+	{
+	public:
+		using ChiliException::ChiliException;
+		virtual std::wstring GetFullMessage() const override { return GetNote() + L"\nAt: " + GetLocation(); }
+		virtual std::wstring GetExceptionType() const override { return L"Mapped File Exception"; }
+	};
+public:
+	// maps the whole file read-only
+	MappedFile( const std::wstring& filename );
+	// creates (or replaces) the file with size bytes and maps it writable
+	MappedFile( const std::wstring& filename,size_t size );
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+	~MappedFile();
+	// nullptr for an empty file
+	const unsigned char* GetData() const;
+	// nullptr unless the file was created writable
+	unsigned char* GetWritableData();
+	size_t GetSize() const;
+	// size and last write time (seconds) of a file, false if it cannot be found
+	static bool GetFileInfo( const std::wstring& filename,uint64_t& size,int64_t& writeTime );
+	// renames from to to, replacing to in one step (mappings of the old to keep its contents)
+	// from is deleted if that fails
+	static void Replace( const std::wstring& from,const std::wstring& to );
+private:
+#ifdef _WIN32
+	void* hFile = nullptr;
+	void* hMapping = nullptr;
+#else
+	int fd = -1;
+#endif
+	unsigned char* pData = nullptr;
+	size_t size = 0u;
+	bool writable = false;
+};
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "Vec3.h"
+#include <cstring>
 
 template <typename T>
 class _Mat3
@@ -5,25 +5,256 @@
 #include "Triangle.h"
 #include "IndexedTriangleList.h"
 #include "PubeScreenTransformer.h"
+#include "ZBuffer.h"
 #include "Mat3.h"
+#include "InstanceTransform.h"
+#include "Rect.h"
+#include "WorkerPool.h"
+#include "PipelineStats.h"
 #include <algorithm>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <type_traits>
+#include <cassert>
+#include <cstring>
+#include <immintrin.h>
+
+// true if a pixel shader declares UsesDerivatives, in which case the pipeline
+// calls it with the attributes' change per pixel in x and y as well
+template<class PS,class = void>
+struct ShaderUsesDerivatives : std::false_type
+{};
+template<class PS>
+struct ShaderUsesDerivatives<PS,typename std::enable_if<PS::UsesDerivatives>::type> : std::true_type
+{};
 
 // triangle drawing pipeline with programable
-// pixel shading stage
+// pixel shading stage and depth testing
 template<class Effect>
 class Pipeline
 {
 public:
 	// vertex type used for geometry and throughout pipeline
 	typedef typename Effect::Vertex Vertex;
+	// how triangles get from the post-transform stage onto the screen
+	enum class RasterMode
+	{
+		// rasterize each triangle right away on the calling thread
+		Serial,
+		// sort triangles into screen tiles and rasterize tiles in parallel
+		Binned
+	};
+	// which algorithm turns a screen space triangle into pixels
+	enum class RasterCore
+	{
+		// split into flat top/bottom halves and walk scanlines
+		Scanline,
+		// evaluate edge functions on 8x8 pixel blocks with SIMD
+		// (same fill rule, but ties on shared edges may round to the other triangle)
+		HalfSpace
+	};
+	// when the pixel shader runs
+	enum class ShadingMode
+	{
+		// shade every fragment that passes the depth test as it is rasterized
+		Immediate,
+		// rasterize triangle ids and depth only, then shade each visible
+		// pixel once in EndFrame (effect state at EndFrame is used for the whole frame)
+		VisibilityBuffer
+	};
+	// edge length of a screen tile in binned mode (pixels)
+	static constexpr int TileSize = 64;
+	static_assert( TileSize % ZBuffer::TileSize == 0,"screen tiles must not split coarse depth tiles" );
+	static_assert( TileSize % FastClear::TileSize == 0,"screen tiles must not share fast clear mask words" );
+	// edge length of a half-space block (pixels)
+	// same as a coarse depth tile, so each block needs one hierarchical z test
+	static constexpr int BlockSize = ZBuffer::TileSize;
 public:
 	Pipeline( Graphics& gfx )
 		:
-		gfx( gfx )
+		Pipeline( gfx,std::make_shared<ZBuffer>( int( Graphics::ScreenWidth ),int( Graphics::ScreenHeight ) ) )
 	{}
-	void Draw( IndexedTriangleList<Vertex>& triList )
+	// pipelines can share a depth buffer (or pass nullptr to draw without depth test)
+	Pipeline( Graphics& gfx,std::shared_ptr<ZBuffer> pZb_in )
+		:
+		gfx( gfx ),
+		pZb( std::move( pZb_in ) )
+	{
+		assert( !pZb || (pZb->GetWidth() == int( Graphics::ScreenWidth ) &&
+			pZb->GetHeight() == int( Graphics::ScreenHeight )) );
+	}
+	// call at the start of every frame before drawing
+	void BeginFrame()
+	{
+		if( pZb )
+		{
+			pZb->Clear();
+		}
+		// ids left over from a frame that never got resolved
+		if( !frameSetups.empty() )
+		{
+			ClearVisibility();
+		}
+	}
+	// call at the end of every frame after drawing
+	// (shades the frame in visibility buffer mode, nothing to do otherwise)
+	void EndFrame()
+	{
+		if( shadingMode == ShadingMode::VisibilityBuffer )
+		{
+			ResolveVisibility();
+		}
+	}
+	void BindDepthBuffer( std::shared_ptr<ZBuffer> pZb_in )
+	{
+		pZb = std::move( pZb_in );
+	}
+	// view space distances of the near and far clipping planes
+	void SetClipPlanes( float zNear_in,float zFar_in )
+	{
+		assert( zNear_in > 0.0f );
+		assert( zFar_in > zNear_in );
+		zNear = zNear_in;
+		zFar = zFar_in;
+	}
+	template<class Index>
+	void Draw( IndexedTriangleList<Vertex,Index>& triList )
+	{
+#ifndef NDEBUG
+		// steady state check: a draw that repeats the last one exactly has the same
+		// workload, so every scratch buffer must be big enough for it already
+		const DrawKey key = MakeDrawKey( triList );
+		const bool repeat = key == lastDraw;
+		const size_t allocationsBefore = scratchAllocations;
+#endif
+		InstanceTransform instance;
+		instance.rotation = rotation;
+		instance.translation = translation;
+		ProcessVertices( triList,instance );
+		if( rasterMode == RasterMode::Binned )
+		{
+			FlushBins();
+		}
+#ifndef NDEBUG
+		assert( !repeat || scratchAllocations == allocationsBefore );
+		lastDraw = key;
+#endif
+	}
+	// draws one copy of the mesh per instance record as a single draw
+	// Instance is InstanceTransform or an effect's type derived from it,
+	// the bound rotation/translation are not used
+	// instances whose bounding sphere is outside the view are skipped whole
+	template<class Index,class Instance>
+	void DrawInstanced( const IndexedTriangleList<Vertex,Index>& mesh,const Instance* pInstances,size_t nInstances )
+	{
+		// mesh bound is shared by all instances
+		float meshRadiusSq = 0.0f;
+		for( const auto& v : mesh.GetVertices() )
+		{
+			meshRadiusSq = std::max( meshRadiusSq,v.pos.LenSq() );
+		}
+		const float meshRadius = sqrt( meshRadiusSq );
+
+		for( size_t i = 0; i < nInstances; i++ )
+		{
+			const Instance& instance = pInstances[i];
+			if( !IsSphereVisible( instance.translation,meshRadius * GetStretchBound( instance.rotation ) ) )
+			{
+				continue;
+			}
+			ProcessVertices( mesh,instance );
+		}
+		// bins are flushed once for the whole batch
+		if( rasterMode == RasterMode::Binned )
+		{
+			FlushBins();
+		}
+	}
+	template<class Index,class Instance>
+	void DrawInstanced( const IndexedTriangleList<Vertex,Index>& mesh,const std::vector<Instance>& instances )
+	{
+		DrawInstanced( mesh,instances.data(),instances.size() );
+	}
+	// select serial or binned rasterization for this pipeline
+	// nThreads is the size of the binned mode worker pool (0 = one per hardware thread)
+	// output is identical in both modes, only the work distribution changes
+	void SetRasterMode( RasterMode mode,unsigned int nThreads = 0u )
+	{
+		rasterMode = mode;
+		if( mode == RasterMode::Binned )
+		{
+			if( !pWorkers || (nThreads != 0u && pWorkers->GetThreadCount() != nThreads) )
+			{
+				pWorkers = std::make_unique<WorkerPool>( nThreads );
+			}
+		}
+		else
+		{
+			pWorkers.reset();
+		}
+	}
+	RasterMode GetRasterMode() const
+	{
+		return rasterMode;
+	}
+	void SetRasterCore( RasterCore core )
+	{
+		rasterCore = core;
+	}
+	RasterCore GetRasterCore() const
+	{
+		return rasterCore;
+	}
+	// switch between shading while rasterizing and the two pass visibility buffer
+	// (call between frames)
+	void SetShadingMode( ShadingMode mode )
+	{
+		shadingMode = mode;
+		if( mode == ShadingMode::VisibilityBuffer && !pVisibility )
+		{
+			// zero initialized, 0 means no triangle
+			pVisibility = std::make_unique<uint32_t[]>( Graphics::ScreenWidth * Graphics::ScreenHeight );
+		}
+	}
+	ShadingMode GetShadingMode() const
+	{
+		return shadingMode;
+	}
+	// number of times the pipeline's scratch buffers had to grow
+	// (the only heap allocations on the draw path, so this stops
+	//  increasing once the pipeline has seen its largest workload)
+	size_t GetScratchAllocationCount() const
+	{
+		return scratchAllocations;
+	}
+	// turn statistics counting on or off (off by default, and a no-op when
+	// PIPELINE_STATS is 0)
+	void SetStatsEnabled( bool enabled )
+	{
+		statsEnabled = enabled;
+	}
+	bool IsStatsEnabled() const
+	{
+		return statsCompiled && statsEnabled;
+	}
+	// totals counted since the pipeline was created
+	PipelineStats GetStats() const
+	{
+		PipelineStats total = stats;
+		total.pixelsShaded = pixelsShaded.load( std::memory_order_relaxed );
+		total.pixelsWritten = pixelsWritten.load( std::memory_order_relaxed );
+		return total;
+	}
+	// counts between BeginQuery and EndQuery (e.g. around one scene's draws)
+	void BeginQuery()
+	{
+		queryStart = GetStats();
+	}
+	PipelineStats EndQuery() const
 	{
-		ProcessVertices( triList.vertices,triList.indices );
+		return GetStats() - queryStart;
 	}
 	void BindRotation( const Mat3& rotation_in )
 	{
@@ -34,201 +265,1016 @@ public:
 		translation = translation_in;
 	}
 private:
+#ifndef NDEBUG
+	// everything a Draw's workload depends on (the list by address, size and edit count)
+	class DrawKey
+	{
+	public:
+		bool operator==( const DrawKey& rhs ) const
+		{
+			return pList == rhs.pList && nVertices == rhs.nVertices && nIndices == rhs.nIndices &&
+				revision == rhs.revision && memcmp( rotation.elements,rhs.rotation.elements,sizeof( rotation.elements ) ) == 0 &&
+				translation.x == rhs.translation.x && translation.y == rhs.translation.y && translation.z == rhs.translation.z &&
+				rasterMode == rhs.rasterMode && rasterCore == rhs.rasterCore &&
+				shadingMode == rhs.shadingMode && zNear == rhs.zNear && zFar == rhs.zFar;
+		}
+	public:
+		const void* pList = nullptr;
+		size_t nVertices = 0u;
+		size_t nIndices = 0u;
+		unsigned int revision = 0u;
+		Mat3 rotation;
+		Vec3 translation;
+		RasterMode rasterMode = RasterMode::Serial;
+		RasterCore rasterCore = RasterCore::Scanline;
+		ShadingMode shadingMode = ShadingMode::Immediate;
+		float zNear = 0.0f;
+		float zFar = 0.0f;
+	};
+	template<class Index>
+	DrawKey MakeDrawKey( const IndexedTriangleList<Vertex,Index>& triList ) const
+	{
+		DrawKey key;
+		key.pList = &triList;
+		key.nVertices = triList.GetVertices().size();
+		key.nIndices = triList.indices.size();
+		key.revision = triList.GetRevision();
+		key.rotation = rotation;
+		key.translation = translation;
+		key.rasterMode = rasterMode;
+		key.rasterCore = rasterCore;
+		key.shadingMode = shadingMode;
+		key.zNear = zNear;
+		key.zFar = zFar;
+		return key;
+	}
+#endif
 	// vertex processing function
-	// transforms vertices and then passes vtx & idx lists to triangle assembler
-	void ProcessVertices( const std::vector<Vertex>& vertices,const std::vector<size_t>& indices )
+	// prepares the post-transform cache and passes vtx & idx lists to triangle assembler
+	// positions are transformed up front from the list's position stream (simd),
+	// the rest of each vertex is assembled lazily by the assembler, so only the
+	// ones the index list actually references get processed
+	template<class Index,class Instance>
+	void ProcessVertices( const IndexedTriangleList<Vertex,Index>& triList,const Instance& instance )
 	{
-		// create vertex vector for vs output
-		std::vector<Vertex> verticesOut;
-
-		// transform vertices using matrix + vector
-		for( const auto& v : vertices )
+		const std::vector<Vertex>& vertices = triList.GetVertices();
+		// cache is sized for the largest mesh seen and reused from draw to draw
+		if( vertices.size() > verticesOut.size() )
 		{
-			verticesOut.emplace_back( v.pos * rotation + translation,v );
+			verticesOut.resize( vertices.size() );
+			vertexStamps.resize( vertices.size(),0u );
+			scratchAllocations++;
+		}
+		if( positionsOut.Resize( vertices.size() ) )
+		{
+			scratchAllocations++;
+		}
+		positionsOut.Transform( triList.GetPositions(),instance.rotation,instance.translation );
+		// bumping the stamp invalidates every cached vertex at once
+		if( ++drawStamp == 0u )
+		{
+			std::fill( vertexStamps.begin(),vertexStamps.end(),0u );
+			drawStamp = 1u;
 		}
 
 		// assemble triangles from stream of indices and vertices
-		AssembleTriangles( verticesOut,indices );
+		AssembleTriangles( vertices,triList.indices,instance );
+	}
+	// returns vertex i of the current draw with its transformed position and
+	// the instance's attributes, assembling it on first use
+	template<class Instance>
+	const Vertex& GetTransformedVertex( const std::vector<Vertex>& vertices,size_t i,const Instance& instance )
+	{
+		if( vertexStamps[i] != drawStamp )
+		{
+			vertexStamps[i] = drawStamp;
+			verticesOut[i] = Vertex( positionsOut.Get( i ),vertices[i] );
+			instance.Apply( verticesOut[i] );
+			Count( &PipelineStats::verticesProcessed );
+		}
+		return verticesOut[i];
+	}
+	// upper bound on how much the matrix can lengthen a vector (frobenius norm)
+	static float GetStretchBound( const Mat3& m )
+	{
+		float sumSq = 0.0f;
+		for( const auto& row : m.elements )
+		{
+			for( float e : row )
+			{
+				sumSq += e * e;
+			}
+		}
+		return sqrt( sumSq );
+	}
+	// false if a view space sphere lies entirely outside the near/far planes
+	// or one of the side planes of the view (x = +-z, y = +-z)
+	bool IsSphereVisible( const Vec3& center,float radius ) const
+	{
+		// distance to the side planes is (x - z) / sqrt( 2 ) etc.
+		const float sideRadius = radius * 1.41421356f;
+		return center.z + radius >= zNear &&
+			center.z - radius <= zFar &&
+			center.x - center.z <= sideRadius &&
+			-center.x - center.z <= sideRadius &&
+			center.y - center.z <= sideRadius &&
+			-center.y - center.z <= sideRadius;
 	}
 	// triangle assembly function
 	// assembles indexed vertex stream into triangles and passes them to post process
 	// culls (does not send) back facing triangles
-	void AssembleTriangles( const std::vector<Vertex>& vertices,const std::vector<size_t>& indices )
+	template<class Index,class Instance>
+	void AssembleTriangles( const std::vector<Vertex>& vertices,const std::vector<Index>& indices,const Instance& instance )
 	{
 		// assemble triangles in the stream and process
 		for( size_t i = 0,end = indices.size() / 3;
 			 i < end; i++ )
 		{
 			// determine triangle vertices via indexing
-			const auto& v0 = vertices[indices[i * 3]];
-			const auto& v1 = vertices[indices[i * 3 + 1]];
-			const auto& v2 = vertices[indices[i * 3 + 2]];
+			const auto& v0 = GetTransformedVertex( vertices,indices[i * 3],instance );
+			const auto& v1 = GetTransformedVertex( vertices,indices[i * 3 + 1],instance );
+			const auto& v2 = GetTransformedVertex( vertices,indices[i * 3 + 2],instance );
+			Count( &PipelineStats::trianglesIn );
 			// cull backfacing triangles with cross product (%) shenanigans
 			if( (v1.pos - v0.pos) % (v2.pos - v0.pos) * v0.pos <= 0.0f )
 			{
 				// process 3 vertices into a triangle
 				ProcessTriangle( v0,v1,v2 );
 			}
+			else
+			{
+				Count( &PipelineStats::trianglesCulled );
+			}
 		}
 	}
 	// triangle processing function
 	// takes 3 vertices to generate triangle
-	// sends generated triangle to post-processing
+	// sends generated triangle to clipping
 	void ProcessTriangle( const Vertex& v0,const Vertex& v1,const Vertex& v2 )
 	{
 		// generate triangle from 3 vertices using gs
-		// and send to post-processing
-		PostProcessTriangleVertices( Triangle<Vertex>{ v0,v1,v2 } );
+		// and send to clipping
+		ClipCullTriangle( Triangle<Vertex>{ v0,v1,v2 } );
+	}
+	// === clipping functions ===
+	//   the guard band is a region well outside the screen that the rasterizer
+	//   can still handle with exact coordinates, so triangles that only cross
+	//   the screen edges are scissored during rasterization rather than clipped
+	//
+	// view space planes, in clipping order (near first, so the guard band planes
+	// through the eye never see vertices behind it)
+	enum ClipPlane
+	{
+		ClipNear,
+		ClipFar,
+		ClipGuardLeft,
+		ClipGuardRight,
+		ClipGuardTop,
+		ClipGuardBottom,
+		ClipPlaneCount
+	};
+	// outcode bits for the clip planes above, followed by the planes of the screen
+	enum OutCode : unsigned int
+	{
+		OutNear = 1u << ClipNear,
+		OutFar = 1u << ClipFar,
+		OutGuard = (1u << ClipGuardLeft) | (1u << ClipGuardRight) | (1u << ClipGuardTop) | (1u << ClipGuardBottom),
+		OutViewLeft = 1u << ClipPlaneCount,
+		OutViewRight = OutViewLeft << 1,
+		OutViewTop = OutViewLeft << 2,
+		OutViewBottom = OutViewLeft << 3,
+		OutView = OutViewLeft | OutViewRight | OutViewTop | OutViewBottom
+	};
+	// guard band extent in normalized device units (screen spans -1 to 1)
+	static constexpr float guardBand = 4.0f;
+	// most vertices a triangle can have after clipping against every plane
+	static constexpr int maxClipVertices = 3 + ClipPlaneCount;
+	// signed distance of p to a clip plane, positive inside
+	float ClipDistance( const Vec3& p,int plane ) const
+	{
+		switch( plane )
+		{
+		case ClipNear:
+			return p.z - zNear;
+		case ClipFar:
+			return zFar - p.z;
+		case ClipGuardLeft:
+			return p.x + guardBand * p.z;
+		case ClipGuardRight:
+			return guardBand * p.z - p.x;
+		case ClipGuardTop:
+			return guardBand * p.z - p.y;
+		default:
+			return p.y + guardBand * p.z;
+		}
+	}
+	unsigned int ComputeOutCode( const Vec3& p ) const
+	{
+		unsigned int code = 0u;
+		for( int plane = 0; plane < ClipPlaneCount; plane++ )
+		{
+			if( ClipDistance( p,plane ) < 0.0f )
+			{
+				code |= 1u << plane;
+			}
+		}
+		if( p.x < -p.z ) code |= OutViewLeft;
+		if( p.x > p.z ) code |= OutViewRight;
+		if( p.y > p.z ) code |= OutViewTop;
+		if( p.y < -p.z ) code |= OutViewBottom;
+		return code;
+	}
+	// triangle clipping function
+	// culls triangles entirely outside the near/far planes or the screen,
+	// passes triangles inside the near/far planes and guard band through untouched,
+	// and clips the rest into a triangle fan that is sent on to post-processing
+	void ClipCullTriangle( const Triangle<Vertex>& triangle )
+	{
+		const unsigned int code0 = ComputeOutCode( triangle.v0.pos );
+		const unsigned int code1 = ComputeOutCode( triangle.v1.pos );
+		const unsigned int code2 = ComputeOutCode( triangle.v2.pos );
+
+		// all vertices outside the same plane
+		if( (code0 & code1 & code2) & (OutNear | OutFar | OutView) )
+		{
+			Count( &PipelineStats::trianglesClipped );
+			return;
+		}
+		// no plane actually crossed (the common case)
+		const unsigned int crossed = (code0 | code1 | code2) & (OutNear | OutFar | OutGuard);
+		if( crossed == 0u )
+		{
+			PostProcessTriangleVertices( triangle );
+			return;
+		}
+		Count( &PipelineStats::trianglesClipped );
+
+		// sutherland-hodgman against each crossed plane, ping-ponging between buffers
+		Vertex polyA[maxClipVertices];
+		Vertex polyB[maxClipVertices];
+		Vertex* pIn = polyA;
+		Vertex* pOut = polyB;
+		pIn[0] = triangle.v0;
+		pIn[1] = triangle.v1;
+		pIn[2] = triangle.v2;
+		int nVertices = 3;
+		for( int plane = 0; plane < ClipPlaneCount; plane++ )
+		{
+			if( !(crossed & (1u << plane)) )
+			{
+				continue;
+			}
+			int nOut = 0;
+			for( int i = 0; i < nVertices; i++ )
+			{
+				const Vertex& a = pIn[i];
+				const Vertex& b = pIn[(i + 1) % nVertices];
+				const float da = ClipDistance( a.pos,plane );
+				const float db = ClipDistance( b.pos,plane );
+				if( da >= 0.0f )
+				{
+					pOut[nOut++] = a;
+				}
+				if( (da >= 0.0f) != (db >= 0.0f) )
+				{
+					pOut[nOut++] = interpolate( a,b,da / (da - db) );
+				}
+			}
+			std::swap( pIn,pOut );
+			nVertices = nOut;
+			if( nVertices < 3 )
+			{
+				return;
+			}
+		}
+
+		// fan out the clipped polygon (keeps the winding of the original)
+		for( int i = 1; i < nVertices - 1; i++ )
+		{
+			PostProcessTriangleVertices( Triangle<Vertex>{ pIn[0],pIn[i],pIn[i + 1] } );
+		}
 	}
 	// vertex post-processing function
 	// perform perspective and viewport transformations
-	void PostProcessTriangleVertices( Triangle<Vertex>& triangle )
+	// and set up the attribute gradients used by the rasterizers
+	void PostProcessTriangleVertices( Triangle<Vertex> triangle )
 	{
 		// perspective divide and screen transform for all 3 vertices
-		pst.Transform( triangle.v0.pos );
-		pst.Transform( triangle.v1.pos );
-		pst.Transform( triangle.v2.pos );
+		// (attributes get divided by z as well, see PubeScreenTransformer)
+		pst.Transform( triangle.v0 );
+		pst.Transform( triangle.v1 );
+		pst.Transform( triangle.v2 );
+
+		// triangles with no area cover no pixel centers
+		TriangleSetup setup;
+		if( !SetupTriangle( triangle,setup ) )
+		{
+			return;
+		}
+		Count( &PipelineStats::trianglesRasterized );
+		if( shadingMode == ShadingMode::VisibilityBuffer )
+		{
+			RecordVisibilityTriangle( triangle,setup );
+		}
+
+		// draw the triangle now or defer it to the tile bins
+		if( rasterMode == RasterMode::Binned )
+		{
+			BinTriangle( triangle,setup );
+		}
+		else
+		{
+			DrawTriangle( triangle,setup,GetScreenRect() );
+		}
+	}
+	// attribute planes of a screen space triangle
+	// the attributes at screen point p are origin + ddx * (p.x - origin.x) + ddy * (p.y - origin.y)
+	struct TriangleSetup
+	{
+		// attributes at the center of pixel (x,y)
+		Vertex At( int x,int y ) const
+		{
+			return origin +
+				ddy * (float( y ) + 0.5f - origin.pos.y) +
+				ddx * (float( x ) + 0.5f - origin.pos.x);
+		}
+		Vertex origin;
+		Vertex ddx;
+		Vertex ddy;
+		// largest 1/z on the triangle, for hierarchical z
+		float nearest;
+		// 1 + index into the frame's triangles in visibility buffer mode
+		uint32_t id;
+	};
+	// computes the change of every attribute per pixel in x and y, once per triangle
+	// (only the attributes the effect's vertex arithmetic carries are interpolated)
+	// returns false for degenerate triangles
+	static bool SetupTriangle( const Triangle<Vertex>& triangle,TriangleSetup& setup )
+	{
+		const Vec3& p0 = triangle.v0.pos;
+		const Vec3& p1 = triangle.v1.pos;
+		const Vec3& p2 = triangle.v2.pos;
+		const float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+		if( area == 0.0f )
+		{
+			return false;
+		}
+		const float invArea = 1.0f / area;
+		const Vertex d1 = triangle.v1 - triangle.v0;
+		const Vertex d2 = triangle.v2 - triangle.v0;
+		setup.origin = triangle.v0;
+		setup.ddx = (d1 * (p2.y - p0.y) - d2 * (p1.y - p0.y)) * invArea;
+		setup.ddy = (d2 * (p1.x - p0.x) - d1 * (p2.x - p0.x)) * invArea;
+		setup.nearest = std::max( { p0.z,p1.z,p2.z } );
+		setup.id = 0u;
+		return true;
+	}
+	// === visibility buffer functions ===
+	//   pass one stores the id of the nearest triangle per pixel, pass two
+	//   evaluates that triangle's attribute planes at the pixel and shades it
+	//
+	// keeps the triangle's setup for the resolve pass and assigns its id
+	void RecordVisibilityTriangle( const Triangle<Vertex>& triangle,TriangleSetup& setup )
+	{
+		setup.id = uint32_t( frameSetups.size() + 1u );
+		PushScratch( frameSetups,setup );
+		// rows the resolve pass has to look at
+		const float minY = std::min( { triangle.v0.pos.y,triangle.v1.pos.y,triangle.v2.pos.y } );
+		const float maxY = std::max( { triangle.v0.pos.y,triangle.v1.pos.y,triangle.v2.pos.y } );
+		visibleTop = std::min( visibleTop,std::max( (int)ceil( minY - 0.5f ),0 ) );
+		visibleBottom = std::max( visibleBottom,std::min( (int)ceil( maxY - 0.5f ),int( Graphics::ScreenHeight ) ) );
+	}
+	// shades every pixel that has a triangle id and clears the ids for the next frame
+	void ResolveVisibility()
+	{
+		const auto resolveRows = [this]( int top,int bottom )
+		{
+			uint64_t shaded = 0u;
+			for( int y = top; y < bottom; y++ )
+			{
+				uint32_t* const pRow = &pVisibility[y * Graphics::ScreenWidth];
+				// attributes are stepped from the screen aligned block start, like both immediate
+				// cores do, so the two shading modes give bit-identical pixels
+				// (attr holds the attributes of triangle lastId at pixel attrX)
+				uint32_t lastId = 0u;
+				int attrX = -1;
+				Vertex attr;
+				for( int x = 0; x < int( Graphics::ScreenWidth ); x++ )
+				{
+					if( const uint32_t id = pRow[x] )
+					{
+						const TriangleSetup& setup = frameSetups[id - 1u];
+						if( id == lastId && attrX == x - 1 && x % BlockSize != 0 )
+						{
+							attr += setup.ddx;
+						}
+						else
+						{
+							const int blockStart = x - x % BlockSize;
+							attr = setup.At( blockStart,y );
+							for( int i = blockStart; i < x; i++ )
+							{
+								attr += setup.ddx;
+							}
+						}
+						lastId = id;
+						attrX = x;
+						gfx.PutPixel( x,y,InvokePixelShader( attr,setup ) );
+						pRow[x] = 0u;
+						shaded++;
+					}
+				}
+			}
+			CountPixels( pixelsShaded,shaded );
+		};
+		if( rasterMode == RasterMode::Binned )
+		{
+			// one screen tile row per work item
+			const int top = visibleTop;
+			const int bottom = visibleBottom;
+			pWorkers->ParallelFor( tilesY,[&]( size_t row )
+			{
+				resolveRows(
+					std::max( int( row ) * TileSize,top ),
+					std::min( (int( row ) + 1) * TileSize,bottom ) );
+			} );
+		}
+		else
+		{
+			resolveRows( visibleTop,visibleBottom );
+		}
+		frameSetups.clear();
+		visibleTop = int( Graphics::ScreenHeight );
+		visibleBottom = 0;
+	}
+	void ClearVisibility()
+	{
+		if( pVisibility )
+		{
+			std::fill_n( pVisibility.get(),Graphics::ScreenWidth * Graphics::ScreenHeight,0u );
+		}
+		frameSetups.clear();
+		visibleTop = int( Graphics::ScreenHeight );
+		visibleBottom = 0;
+	}
+	// === tile binning functions ===
+	//
+	// records triangle and adds its index to the bin of every tile its bounding box touches
+	void BinTriangle( const Triangle<Vertex>& triangle,const TriangleSetup& setup )
+	{
+		const float minX = std::min( { triangle.v0.pos.x,triangle.v1.pos.x,triangle.v2.pos.x } );
+		const float maxX = std::max( { triangle.v0.pos.x,triangle.v1.pos.x,triangle.v2.pos.x } );
+		const float minY = std::min( { triangle.v0.pos.y,triangle.v1.pos.y,triangle.v2.pos.y } );
+		const float maxY = std::max( { triangle.v0.pos.y,triangle.v1.pos.y,triangle.v2.pos.y } );
 
-		// draw the triangle
-		DrawTriangle( triangle );
+		// same pixel center rule as the rasterizer, clamped to the screen
+		const RectI screen = GetScreenRect();
+		const int left = std::max( (int)ceil( minX - 0.5f ),screen.left );
+		const int right = std::min( (int)ceil( maxX - 0.5f ),screen.right );
+		const int top = std::max( (int)ceil( minY - 0.5f ),screen.top );
+		const int bottom = std::min( (int)ceil( maxY - 0.5f ),screen.bottom );
+		if( left >= right || top >= bottom )
+		{
+			return;
+		}
+
+		const size_t index = binnedTriangles.size();
+		PushScratch( binnedTriangles,triangle );
+		PushScratch( binnedSetups,setup );
+		for( int ty = top / TileSize; ty <= (bottom - 1) / TileSize; ty++ )
+		{
+			for( int tx = left / TileSize; tx <= (right - 1) / TileSize; tx++ )
+			{
+				PushScratch( tileBins[ty * tilesX + tx],index );
+			}
+		}
+	}
+	// rasterizes all binned triangles, one tile per work item
+	// each tile draws its triangles in submission order and only touches its own pixels,
+	// so the result matches the serial path exactly
+	void FlushBins()
+	{
+		pWorkers->ParallelFor( tileBins.size(),[this]( size_t tile )
+		{
+			const int tx = int( tile % tilesX );
+			const int ty = int( tile / tilesX );
+			const RectI tileRect = {
+				ty * TileSize,
+				std::min( (ty + 1) * TileSize,int( Graphics::ScreenHeight ) ),
+				tx * TileSize,
+				std::min( (tx + 1) * TileSize,int( Graphics::ScreenWidth ) )
+			};
+			for( const size_t index : tileBins[tile] )
+			{
+				DrawTriangle( binnedTriangles[index],binnedSetups[index],tileRect );
+			}
+		} );
+
+		// keep capacity around for the next draw
+		binnedTriangles.clear();
+		binnedSetups.clear();
+		for( auto& bin : tileBins )
+		{
+			bin.clear();
+		}
+	}
+	// push_back on a buffer that is cleared (not freed) every draw,
+	// counting the times it has to grow
+	template<typename T>
+	void PushScratch( std::vector<T>& buffer,const T& item )
+	{
+		if( buffer.size() == buffer.capacity() )
+		{
+			scratchAllocations++;
+		}
+		buffer.push_back( item );
+	}
+	static RectI GetScreenRect()
+	{
+		return{ 0,int( Graphics::ScreenHeight ),0,int( Graphics::ScreenWidth ) };
 	}
 	// === triangle rasterization functions ===
-	//   it0, it1, etc. stand for interpolants
-	//   (values which are interpolated across a triangle in screen space)
+	//   the scanline functions only track the x extents of the triangle edges,
+	//   attributes come from the triangle's gradients
+	//   clip is the pixel rectangle the triangle is allowed to touch
+	//   (whole screen in serial mode, one tile in binned mode)
 	//
 	// entry point for tri rasterization
 	// sorts vertices, determines case, splits to flat tris, dispatches to flat tri funcs
-	void DrawTriangle( const Triangle<Vertex>& triangle )
+	void DrawTriangle( const Triangle<Vertex>& triangle,const TriangleSetup& setup,const RectI& clip )
 	{
+		if( rasterCore == RasterCore::HalfSpace )
+		{
+			DrawTriangleHalfSpace( triangle,setup,clip );
+			return;
+		}
+
 		// using pointers so we can swap (for sorting purposes)
-		const Vertex* pv0 = &triangle.v0;
-		const Vertex* pv1 = &triangle.v1;
-		const Vertex* pv2 = &triangle.v2;
+		const Vec3* pv0 = &triangle.v0.pos;
+		const Vec3* pv1 = &triangle.v1.pos;
+		const Vec3* pv2 = &triangle.v2.pos;
 
 		// sorting vertices by y
-		if( pv1->pos.y < pv0->pos.y ) std::swap( pv0,pv1 );
-		if( pv2->pos.y < pv1->pos.y ) std::swap( pv1,pv2 );
-		if( pv1->pos.y < pv0->pos.y ) std::swap( pv0,pv1 );
+		if( pv1->y < pv0->y ) std::swap( pv0,pv1 );
+		if( pv2->y < pv1->y ) std::swap( pv1,pv2 );
+		if( pv1->y < pv0->y ) std::swap( pv0,pv1 );
 
-		if( pv0->pos.y == pv1->pos.y ) // natural flat top
+		if( pv0->y == pv1->y ) // natural flat top
 		{
 			// sorting top vertices by x
-			if( pv1->pos.x < pv0->pos.x ) std::swap( pv0,pv1 );
+			if( pv1->x < pv0->x ) std::swap( pv0,pv1 );
 
-			DrawFlatTopTriangle( *pv0,*pv1,*pv2 );
+			DrawFlatTopTriangle( *pv0,*pv1,*pv2,setup,clip );
 		}
-		else if( pv1->pos.y == pv2->pos.y ) // natural flat bottom
+		else if( pv1->y == pv2->y ) // natural flat bottom
 		{
 			// sorting bottom vertices by x
-			if( pv2->pos.x < pv1->pos.x ) std::swap( pv1,pv2 );
+			if( pv2->x < pv1->x ) std::swap( pv1,pv2 );
 
-			DrawFlatBottomTriangle( *pv0,*pv1,*pv2 );
+			DrawFlatBottomTriangle( *pv0,*pv1,*pv2,setup,clip );
 		}
 		else // general triangle
 		{
-			// find splitting vertex interpolant
+			// find splitting vertex
 			const float alphaSplit =
-				(pv1->pos.y - pv0->pos.y) /
-				(pv2->pos.y - pv0->pos.y);
+				(pv1->y - pv0->y) /
+				(pv2->y - pv0->y);
 			const auto vi = interpolate( *pv0,*pv2,alphaSplit );
 
-			if( pv1->pos.x < vi.pos.x ) // major right
+			if( pv1->x < vi.x ) // major right
 			{
-				DrawFlatBottomTriangle( *pv0,*pv1,vi );
-				DrawFlatTopTriangle( *pv1,vi,*pv2 );
+				DrawFlatBottomTriangle( *pv0,*pv1,vi,setup,clip );
+				DrawFlatTopTriangle( *pv1,vi,*pv2,setup,clip );
 			}
 			else // major left
 			{
-				DrawFlatBottomTriangle( *pv0,vi,*pv1 );
-				DrawFlatTopTriangle( vi,*pv1,*pv2 );
+				DrawFlatBottomTriangle( *pv0,vi,*pv1,setup,clip );
+				DrawFlatTopTriangle( vi,*pv1,*pv2,setup,clip );
 			}
 		}
 	}
 	// does flat *TOP* tri-specific calculations and calls DrawFlatTriangle
-	void DrawFlatTopTriangle( const Vertex& it0,
-							  const Vertex& it1,
-							  const Vertex& it2 )
+	void DrawFlatTopTriangle( const Vec3& p0,
+							  const Vec3& p1,
+							  const Vec3& p2,
+							  const TriangleSetup& setup,
+							  const RectI& clip )
 	{
-		// calulcate dVertex / dy
-		// change in interpolant for every 1 change in y
-		const float delta_y = it2.pos.y - it0.pos.y;
-		const auto dit0 = (it2 - it0) / delta_y;
-		const auto dit1 = (it2 - it1) / delta_y;
-
-		// create right edge interpolant
-		auto itEdge1 = it1;
+		// calulcate dx / dy
+		// change in edge x for every 1 change in y
+		const float delta_y = p2.y - p0.y;
+		const float dx0 = (p2.x - p0.x) / delta_y;
+		const float dx1 = (p2.x - p1.x) / delta_y;
 
-		// call the flat triangle render routine
-		DrawFlatTriangle( it0,it1,it2,dit0,dit1,itEdge1 );
+		// right edge starts at p1
+		DrawFlatTriangle( p0,p1,p2,dx0,dx1,p1.x,setup,clip );
 	}
 	// does flat *BOTTOM* tri-specific calculations and calls DrawFlatTriangle
-	void DrawFlatBottomTriangle( const Vertex& it0,
-								 const Vertex& it1,
-								 const Vertex& it2 )
+	void DrawFlatBottomTriangle( const Vec3& p0,
+								 const Vec3& p1,
+								 const Vec3& p2,
+								 const TriangleSetup& setup,
+								 const RectI& clip )
 	{
-		// calulcate dVertex / dy
-		// change in interpolant for every 1 change in y
-		const float delta_y = it2.pos.y - it0.pos.y;
-		const auto dit0 = (it1 - it0) / delta_y;
-		const auto dit1 = (it2 - it0) / delta_y;
+		// calulcate dx / dy
+		// change in edge x for every 1 change in y
+		const float delta_y = p2.y - p0.y;
+		const float dx0 = (p1.x - p0.x) / delta_y;
+		const float dx1 = (p2.x - p0.x) / delta_y;
 
-		// create right edge interpolant
-		auto itEdge1 = it0;
-
-		// call the flat triangle render routine
-		DrawFlatTriangle( it0,it1,it2,dit0,dit1,itEdge1 );
+		// right edge starts at p0
+		DrawFlatTriangle( p0,p1,p2,dx0,dx1,p0.x,setup,clip );
 	}
 	// does processing common to both flat top and flat bottom tris
-	// scan over triangle in screen space, interpolate attributes,
-	// invoke ps and write pixel to screen
-	void DrawFlatTriangle( const Vertex& it0,
-						   const Vertex& it1,
-						   const Vertex& it2,
-						   const Vertex& dv0,
-						   const Vertex& dv1,
-						   Vertex itEdge1 )
-	{
-		// create edge interpolant for left edge (always v0)
-		auto itEdge0 = it0;
-
+	// scan over triangle in screen space, evaluate attributes,
+	// depth test, invoke ps and write pixel to screen
+	// edges are evaluated directly for every scanline, and attributes are stepped
+	// from screen aligned 8 pixel boundaries, so the values at a pixel do not
+	// depend on where the clip rectangle starts the walk
+	void DrawFlatTriangle( const Vec3& p0,
+						   const Vec3& p1,
+						   const Vec3& p2,
+						   float dx0,
+						   float dx1,
+						   float edge1X,
+						   const TriangleSetup& setup,
+						   const RectI& clip )
+	{
 		// calculate start and end scanlines
-		const int yStart = (int)ceil( it0.pos.y - 0.5f );
-		const int yEnd = (int)ceil( it2.pos.y - 0.5f ); // the scanline AFTER the last line drawn
+		const int yStart = std::max( (int)ceil( p0.y - 0.5f ),clip.top );
+		const int yEnd = std::min( (int)ceil( p2.y - 0.5f ),clip.bottom ); // the scanline AFTER the last line drawn
 
-		// do interpolant prestep
-		itEdge0 += dv0 * (float( yStart ) + 0.5f - it0.pos.y);
-		itEdge1 += dv1 * (float( yStart ) + 0.5f - it0.pos.y);
+		// columns the triangle can touch, for testing it against whole depth tiles
+		constexpr int ts = ZBuffer::TileSize;
+		const int xMin = std::max( (int)ceil( std::min( { p0.x,p1.x,p2.x } ) - 0.5f ),clip.left );
+		const int xMax = std::min( (int)ceil( std::max( { p0.x,p1.x,p2.x } ) - 0.5f ),clip.right );
+		// occlusion of the depth tiles in the current band of scanlines
+		// (tiles are queried once per band, not per scanline, since writes
+		//  from the previous scanline would force a rescan of the tile)
+		bool tileOccluded[(Graphics::ScreenWidth + ts - 1) / ts];
+		int bandEnd = yStart;
+		uint64_t written = 0u;
 
-		for( int y = yStart; y < yEnd; y++,itEdge0 += dv0,itEdge1 += dv1 )
+		for( int y = yStart; y < yEnd; y++ )
 		{
+			if( pZb && y >= bandEnd )
+			{
+				const int ty = y / ts;
+				bandEnd = (ty + 1) * ts;
+				for( int tx = xMin / ts; xMin < xMax && tx <= (xMax - 1) / ts; tx++ )
+				{
+					tileOccluded[tx] = pZb->IsTileOccluded( tx,ty,setup.nearest );
+				}
+			}
+
+			// evaluate edges at this scanline's pixel centers
+			const float edgeStep = float( y ) + 0.5f - p0.y;
+			const float edge0X = p0.x + dx0 * edgeStep;
+			const float edgeX1 = edge1X + dx1 * edgeStep;
+
 			// calculate start and end pixels
-			const int xStart = (int)ceil( itEdge0.pos.x - 0.5f );
-			const int xEnd = (int)ceil( itEdge1.pos.x - 0.5f ); // the pixel AFTER the last pixel drawn
+			// (kept inside the clipped bounding box, which the tile flags cover)
+			const int xStart = std::max( (int)ceil( edge0X - 0.5f ),xMin );
+			const int xEnd = std::min( (int)ceil( edgeX1 - 0.5f ),xMax ); // the pixel AFTER the last pixel drawn
 
-			// create scanline interpolant startpoint
-			// (some waste for interpolating x,y,z, but makes life easier not having
-			//  to split them off, and z will be needed in the future anyways...)
-			auto iLine = itEdge0;
+			// walk the span one depth tile segment at a time
+			for( int x = xStart; x < xEnd; )
+			{
+				const int segmentStart = x - x % ts;
+				const int segmentEnd = std::min( segmentStart + ts,xEnd );
+				if( pZb && tileOccluded[x / ts] )
+				{
+					x = segmentEnd;
+					continue;
+				}
+				auto attr = setup.At( segmentStart,y );
+				for( int i = segmentStart; i < x; i++ )
+				{
+					attr += setup.ddx;
+				}
+				for( ; x < segmentEnd; x++,attr += setup.ddx )
+				{
+					written += ShadePixel( x,y,attr,setup );
+				}
+			}
+		}
+		CountPixelsWritten( written );
+	}
+	// early z test, then recover the perspective correct attributes
+	// invoke pixel shader and write resulting color value
+	// (in visibility buffer mode only the triangle id is written)
+	// returns whether the pixel was written
+	bool ShadePixel( int x,int y,const Vertex& attr,const TriangleSetup& setup )
+	{
+		if( !pZb || pZb->TestAndSet( x,y,attr.pos.z ) )
+		{
+			if( shadingMode == ShadingMode::VisibilityBuffer )
+			{
+				pVisibility[y * Graphics::ScreenWidth + x] = setup.id;
+				return true;
+			}
+			gfx.PutPixel( x,y,InvokePixelShader( attr,setup ) );
+			return true;
+		}
+		return false;
+	}
+	// recovers the perspective correct attributes and runs the pixel shader
+	// (attributes were interpolated divided by z, pos.z holds 1/z)
+	Color InvokePixelShader( const Vertex& attr,const TriangleSetup& setup ) const
+	{
+		return InvokePixelShader( attr,setup,ShaderUsesDerivatives<typename Effect::PixelShader>{} );
+	}
+	Color InvokePixelShader( const Vertex& attr,const TriangleSetup&,std::false_type ) const
+	{
+		return effect.ps( attr * (1.0f / attr.pos.z) );
+	}
+	Color InvokePixelShader( const Vertex& attr,const TriangleSetup& setup,std::true_type ) const
+	{
+		const float z = 1.0f / attr.pos.z;
+		const Vertex in = attr * z;
+		// a = (a/z) * z, so da = (d(a/z) - a * d(1/z)) * z
+		const Vertex ddx = (setup.ddx - in * setup.ddx.pos.z) * z;
+		const Vertex ddy = (setup.ddy - in * setup.ddy.pos.z) * z;
+		return effect.ps( in,ddx,ddy );
+	}
+	// === half-space rasterization functions ===
+	//   a pixel is inside when all three edge functions are positive at its center
+	//   pixels exactly on an edge belong to top and left edges only, the same top-left
+	//   rule as the ceil( x - 0.5f ) spans of the scanline rasterizer
+	//   the edges are computed differently than there though, so a pixel center within
+	//   rounding of an edge shared by two triangles can go to the other triangle than in
+	//   the scanline core (the mesh covers the same pixels, a few may change color)
+	//
+	// one edge function E(p) = A * (p.x - ax) + B * (p.y - ay)
+	struct HalfSpaceEdge
+	{
+		HalfSpaceEdge() = default;
+		HalfSpaceEdge( const Vec3& a,const Vec3& b )
+			:
+			A( a.y - b.y ),
+			B( b.x - a.x ),
+			ax( a.x ),
+			ay( a.y ),
+			// inward normal pointing right (left edge) or down (top edge)
+			inclusive( A > 0.0f || (A == 0.0f && B > 0.0f) )
+		{}
+		float Evaluate( float px,float py ) const
+		{
+			return A * (px - ax) + B * (py - ay);
+		}
+		float A;
+		float B;
+		float ax;
+		float ay;
+		bool inclusive;
+	};
+	// entry point for half-space tri rasterization
+	// walks the 8x8 blocks (aligned to the screen) under the triangle bounding box,
+	// rejects blocks outside any edge, accepts blocks inside all edges whole and
+	// builds a per pixel coverage mask for the rest
+	void DrawTriangleHalfSpace( const Triangle<Vertex>& triangle,const TriangleSetup& setup,const RectI& clip )
+	{
+		const Vertex* pv0 = &triangle.v0;
+		const Vertex* pv1 = &triangle.v1;
+		const Vertex* pv2 = &triangle.v2;
 
-			// calculate delta scanline interpolant / dx
-			const float dx = itEdge1.pos.x - itEdge0.pos.x;
-			const auto diLine = (itEdge1 - iLine) / dx;
+		// twice the signed area, make winding positive so inside means E > 0
+		const float area =
+			(pv1->pos.x - pv0->pos.x) * (pv2->pos.y - pv0->pos.y) -
+			(pv1->pos.y - pv0->pos.y) * (pv2->pos.x - pv0->pos.x);
+		if( area < 0.0f )
+		{
+			std::swap( pv1,pv2 );
+		}
 
-			// prestep scanline interpolant
-			iLine += diLine * (float( xStart ) + 0.5f - itEdge0.pos.x);
+		const HalfSpaceEdge edges[3] = {
+			{ pv1->pos,pv2->pos },
+			{ pv2->pos,pv0->pos },
+			{ pv0->pos,pv1->pos }
+		};
+
+		// pixel range of the bounding box (same center rule as scanline), clipped
+		const int xStart = std::max( (int)ceil( std::min( { pv0->pos.x,pv1->pos.x,pv2->pos.x } ) - 0.5f ),clip.left );
+		const int xEnd = std::min( (int)ceil( std::max( { pv0->pos.x,pv1->pos.x,pv2->pos.x } ) - 0.5f ),clip.right );
+		const int yStart = std::max( (int)ceil( std::min( { pv0->pos.y,pv1->pos.y,pv2->pos.y } ) - 0.5f ),clip.top );
+		const int yEnd = std::min( (int)ceil( std::max( { pv0->pos.y,pv1->pos.y,pv2->pos.y } ) - 0.5f ),clip.bottom );
+		if( xStart >= xEnd || yStart >= yEnd )
+		{
+			return;
+		}
 
-			for( int x = xStart; x < xEnd; x++,iLine += diLine )
+		uint64_t written = 0u;
+		for( int by = yStart - yStart % BlockSize; by < yEnd; by += BlockSize )
+		{
+			// rows of this block that lie inside the range
+			const int rowFirst = std::max( yStart - by,0 );
+			const int rowLast = std::min( yEnd - by,BlockSize );
+			for( int bx = xStart - xStart % BlockSize; bx < xEnd; bx += BlockSize )
 			{
-				// invoke pixel shader and write resulting color value
-				gfx.PutPixel( x,y,effect.ps( iLine ) );
+				const int colFirst = std::max( xStart - bx,0 );
+				const int colLast = std::min( xEnd - bx,BlockSize );
+
+				// classify block by the edge values at its corner pixel centers
+				const float x0 = float( bx ) + 0.5f;
+				const float x1 = float( bx + BlockSize ) - 0.5f;
+				const float y0 = float( by ) + 0.5f;
+				const float y1 = float( by + BlockSize ) - 0.5f;
+				bool rejected = false;
+				bool accepted = true;
+				for( const auto& e : edges )
+				{
+					const float c0 = e.Evaluate( x0,y0 );
+					const float c1 = e.Evaluate( x1,y0 );
+					const float c2 = e.Evaluate( x0,y1 );
+					const float c3 = e.Evaluate( x1,y1 );
+					if( std::max( { c0,c1,c2,c3 } ) < 0.0f )
+					{
+						rejected = true;
+						break;
+					}
+					accepted = accepted && std::min( { c0,c1,c2,c3 } ) > 0.0f;
+				}
+				if( rejected )
+				{
+					continue;
+				}
+				// whole block behind what has already been drawn there
+				if( pZb && pZb->IsTileOccluded( bx / BlockSize,by / BlockSize,setup.nearest ) )
+				{
+					continue;
+				}
+
+				// coverage mask, bit ( row * 8 + col ) set for covered pixels
+				uint64_t mask = 0u;
+				const unsigned int colMask = (0xFFu >> (BlockSize - colLast)) & (0xFFu << colFirst);
+				for( int row = rowFirst; row < rowLast; row++ )
+				{
+					const unsigned int rowMask = accepted ?
+						colMask : (CoverRow( edges,bx,by + row ) & colMask);
+					mask |= uint64_t( rowMask ) << (row * BlockSize);
+				}
+				if( mask != 0u )
+				{
+					written += ShadeBlock( bx,by,mask,setup );
+				}
 			}
 		}
+		CountPixelsWritten( written );
+	}
+	// coverage of the 8 pixels starting at (x,y) as a bit mask
+	static unsigned int CoverRow( const HalfSpaceEdge* edges,int x,int y )
+	{
+		const float px = float( x );
+		const float py = float( y ) + 0.5f;
+#if defined( __AVX__ )
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 centers = _mm256_setr_ps( 0.5f,1.5f,2.5f,3.5f,4.5f,5.5f,6.5f,7.5f );
+		__m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+		for( int i = 0; i < 3; i++ )
+		{
+			const HalfSpaceEdge& e = edges[i];
+			const __m256 dx = _mm256_add_ps( _mm256_set1_ps( px - e.ax ),centers );
+			const __m256 E = _mm256_add_ps(
+				_mm256_mul_ps( _mm256_set1_ps( e.A ),dx ),
+				_mm256_set1_ps( e.B * (py - e.ay) ) );
+			const __m256 incl = _mm256_castsi256_ps( _mm256_set1_epi32( e.inclusive ? -1 : 0 ) );
+			const __m256 test = _mm256_or_ps( _mm256_cmp_ps( E,zero,_CMP_GT_OQ ),
+				_mm256_and_ps( _mm256_cmp_ps( E,zero,_CMP_EQ_OQ ),incl ) );
+			inside = _mm256_and_ps( inside,test );
+		}
+		return (unsigned int)_mm256_movemask_ps( inside );
+#else
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 centersLo = _mm_setr_ps( 0.5f,1.5f,2.5f,3.5f );
+		const __m128 centersHi = _mm_setr_ps( 4.5f,5.5f,6.5f,7.5f );
+		__m128 insideLo = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+		__m128 insideHi = insideLo;
+		for( int i = 0; i < 3; i++ )
+		{
+			const HalfSpaceEdge& e = edges[i];
+			const __m128 A = _mm_set1_ps( e.A );
+			const __m128 base = _mm_set1_ps( px - e.ax );
+			const __m128 Ey = _mm_set1_ps( e.B * (py - e.ay) );
+			const __m128 incl = _mm_castsi128_ps( _mm_set1_epi32( e.inclusive ? -1 : 0 ) );
+			const __m128 ELo = _mm_add_ps( _mm_mul_ps( A,_mm_add_ps( base,centersLo ) ),Ey );
+			const __m128 EHi = _mm_add_ps( _mm_mul_ps( A,_mm_add_ps( base,centersHi ) ),Ey );
+			insideLo = _mm_and_ps( insideLo,_mm_or_ps( _mm_cmpgt_ps( ELo,zero ),
+				_mm_and_ps( _mm_cmpeq_ps( ELo,zero ),incl ) ) );
+			insideHi = _mm_and_ps( insideHi,_mm_or_ps( _mm_cmpgt_ps( EHi,zero ),
+				_mm_and_ps( _mm_cmpeq_ps( EHi,zero ),incl ) ) );
+		}
+		return (unsigned int)_mm_movemask_ps( insideLo ) |
+			((unsigned int)_mm_movemask_ps( insideHi ) << 4);
+#endif
+	}
+	// depth test and invoke ps for every pixel of the block set in the coverage mask
+	// returns the number of pixels written
+	unsigned int ShadeBlock( int bx,int by,uint64_t mask,const TriangleSetup& setup )
+	{
+		unsigned int written = 0u;
+		for( int row = 0; row < BlockSize; row++ )
+		{
+			const unsigned int rowMask = (unsigned int)(mask >> (row * BlockSize)) & 0xFFu;
+			if( rowMask == 0u )
+			{
+				continue;
+			}
+			const int y = by + row;
+			// step along the row from the block's left edge
+			// (blocks are screen aligned, so this is the same for any clip rect)
+			auto attr = setup.At( bx,y );
+			if( rowMask == 0xFFu )
+			{
+				// fully covered row, no per pixel mask tests
+				for( int x = bx; x < bx + BlockSize; x++,attr += setup.ddx )
+				{
+					written += ShadePixel( x,y,attr,setup );
+				}
+				continue;
+			}
+			for( int col = 0; col < BlockSize; col++,attr += setup.ddx )
+			{
+				if( rowMask & (1u << col) )
+				{
+					written += ShadePixel( bx + col,y,attr,setup );
+				}
+			}
+		}
+		return written;
+	}
+	// === statistics functions ===
+	//
+	// front end counters are only touched by the drawing thread
+	void Count( uint64_t PipelineStats::* counter,uint64_t n = 1u )
+	{
+		if( statsCompiled && statsEnabled )
+		{
+			stats.*counter += n;
+		}
+	}
+	// pixel counters are added to from the rasterizer threads, once per triangle
+	void CountPixels( std::atomic<uint64_t>& counter,uint64_t n )
+	{
+		if( statsCompiled && statsEnabled && n != 0u )
+		{
+			counter.fetch_add( n,std::memory_order_relaxed );
+		}
+	}
+	void CountPixelsWritten( uint64_t n )
+	{
+		CountPixels( pixelsWritten,n );
+		// immediate mode shades every pixel it writes
+		if( shadingMode == ShadingMode::Immediate )
+		{
+			CountPixels( pixelsShaded,n );
+		}
 	}
 public:
 	Effect effect;
 private:
 	Graphics& gfx;
+	std::shared_ptr<ZBuffer> pZb;
 	PubeScreenTransformer pst;
 	Mat3 rotation;
 	Vec3 translation;
-};
\ No newline at end of file
+	float zNear = 0.1f;
+	float zFar = 100.0f;
+	// post-transform vertex cache, entries are valid when their stamp matches the draw's
+	std::vector<Vertex> verticesOut;
+	std::vector<unsigned int> vertexStamps;
+	PositionStream positionsOut;
+	unsigned int drawStamp = 0u;
+	size_t scratchAllocations = 0u;
+#ifndef NDEBUG
+	DrawKey lastDraw;
+#endif
+	RasterCore rasterCore = RasterCore::Scanline;
+	// binned rasterization state
+	RasterMode rasterMode = RasterMode::Serial;
+	std::unique_ptr<WorkerPool> pWorkers;
+	static constexpr int tilesX = (int( Graphics::ScreenWidth ) + TileSize - 1) / TileSize;
+	static constexpr int tilesY = (int( Graphics::ScreenHeight ) + TileSize - 1) / TileSize;
+	std::vector<Triangle<Vertex>> binnedTriangles;
+	std::vector<TriangleSetup> binnedSetups;
+	std::vector<std::vector<size_t>> tileBins = std::vector<std::vector<size_t>>( tilesX * tilesY );
+	// visibility buffer state
+	ShadingMode shadingMode = ShadingMode::Immediate;
+	std::unique_ptr<uint32_t[]> pVisibility;
+	std::vector<TriangleSetup> frameSetups;
+	// range of rows that may hold triangle ids
+	int visibleTop = int( Graphics::ScreenHeight );
+	int visibleBottom = 0;
+	// statistics
+	static constexpr bool statsCompiled = PIPELINE_STATS != 0;
+	bool statsEnabled = false;
+	PipelineStats stats;
+	std::atomic<uint64_t> pixelsShaded = { 0u };
+	std::atomic<uint64_t> pixelsWritten = { 0u };
+	PipelineStats queryStart;
+};
+
+// std::min takes its arguments by reference, so the constants it is given need a definition
+template<class Effect>
+constexpr int Pipeline<Effect>::TileSize;
+template<class Effect>
+constexpr int Pipeline<Effect>::BlockSize;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+// define as 0 to compile all pipeline statistics counting out
+#ifndef PIPELINE_STATS
+#define PIPELINE_STATS 1
+#endif
+
+// work counters of a Pipeline, in the spirit of d3d pipeline statistics queries
+class PipelineStats
+{
+public:
+	PipelineStats& operator+=( const PipelineStats& rhs )
+	{
+		verticesProcessed += rhs.verticesProcessed;
+		trianglesIn += rhs.trianglesIn;
+		trianglesCulled += rhs.trianglesCulled;
+		trianglesClipped += rhs.trianglesClipped;
+		trianglesRasterized += rhs.trianglesRasterized;
+		pixelsShaded += rhs.pixelsShaded;
+		pixelsWritten += rhs.pixelsWritten;
+		return *this;
+	}
+	PipelineStats& operator-=( const PipelineStats& rhs )
+	{
+		verticesProcessed -= rhs.verticesProcessed;
+		trianglesIn -= rhs.trianglesIn;
+		trianglesCulled -= rhs.trianglesCulled;
+		trianglesClipped -= rhs.trianglesClipped;
+		trianglesRasterized -= rhs.trianglesRasterized;
+		pixelsShaded -= rhs.pixelsShaded;
+		pixelsWritten -= rhs.pixelsWritten;
+		return *this;
+	}
+	PipelineStats operator-( const PipelineStats& rhs ) const
+	{
+		return PipelineStats( *this ) -= rhs;
+	}
+public:
+	// vertices assembled by the vertex stage
+	uint64_t verticesProcessed = 0u;
+	// triangles assembled from the index list
+	uint64_t trianglesIn = 0u;
+	// triangles dropped by back face culling
+	uint64_t trianglesCulled = 0u;
+	// triangles cut by a clip plane or lying entirely outside one
+	uint64_t trianglesClipped = 0u;
+	// triangles (after clipping) handed to the rasterizer
+	uint64_t trianglesRasterized = 0u;
+	// pixel shader invocations
+	uint64_t pixelsShaded = 0u;
+	// pixels that passed the depth test and were written
+	// (to the color buffer, or the id buffer in visibility buffer mode)
+	uint64_t pixelsWritten = 0u;
+};
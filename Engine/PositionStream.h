@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Vec3.h"
+#include "Mat3.h"
+#include <vector>
+#include <immintrin.h>
+
+// vertex positions as structure of arrays (all x, then all y, then all z)
+// padded to a multiple of Width so they can be transformed Width at a time
+class PositionStream
+{
+public:
+	static constexpr size_t Width = 8;
+public:
+	PositionStream() = default;
+	template<class V>
+	explicit PositionStream( const std::vector<V>& vertices )
+	{
+		Assign( vertices );
+	}
+	// copy the positions out of a vertex array
+	template<class V>
+	void Assign( const std::vector<V>& vertices )
+	{
+		Resize( vertices.size() );
+		for( size_t i = 0; i < vertices.size(); i++ )
+		{
+			xs[i] = vertices[i].pos.x;
+			ys[i] = vertices[i].pos.y;
+			zs[i] = vertices[i].pos.z;
+		}
+	}
+	// set number of positions, returns true if storage had to grow
+	// (padding positions are zero)
+	bool Resize( size_t size )
+	{
+		count = size;
+		const size_t padded = (size + Width - 1) / Width * Width;
+		if( padded > xs.size() )
+		{
+			xs.resize( padded,0.0f );
+			ys.resize( padded,0.0f );
+			zs.resize( padded,0.0f );
+			return true;
+		}
+		return false;
+	}
+	size_t GetSize() const
+	{
+		return count;
+	}
+	Vec3 Get( size_t i ) const
+	{
+		return { xs[i],ys[i],zs[i] };
+	}
+	// this = in * rotation + translation, for every position of in
+	// (same operation order as Vec3 * Mat3, so results match the scalar transform)
+	void Transform( const PositionStream& in,const Mat3& rotation,const Vec3& translation )
+	{
+		Resize( in.count );
+		const auto& m = rotation.elements;
+		const size_t end = (count + Width - 1) / Width * Width;
+#if defined( __AVX__ )
+		const __m256 m00 = _mm256_set1_ps( m[0][0] ),m01 = _mm256_set1_ps( m[0][1] ),m02 = _mm256_set1_ps( m[0][2] );
+		const __m256 m10 = _mm256_set1_ps( m[1][0] ),m11 = _mm256_set1_ps( m[1][1] ),m12 = _mm256_set1_ps( m[1][2] );
+		const __m256 m20 = _mm256_set1_ps( m[2][0] ),m21 = _mm256_set1_ps( m[2][1] ),m22 = _mm256_set1_ps( m[2][2] );
+		const __m256 tx = _mm256_set1_ps( translation.x );
+		const __m256 ty = _mm256_set1_ps( translation.y );
+		const __m256 tz = _mm256_set1_ps( translation.z );
+		for( size_t i = 0; i < end; i += 8 )
+		{
+			const __m256 x = _mm256_loadu_ps( &in.xs[i] );
+			const __m256 y = _mm256_loadu_ps( &in.ys[i] );
+			const __m256 z = _mm256_loadu_ps( &in.zs[i] );
+			_mm256_storeu_ps( &xs[i],_mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+				_mm256_mul_ps( x,m00 ),_mm256_mul_ps( y,m10 ) ),_mm256_mul_ps( z,m20 ) ),tx ) );
+			_mm256_storeu_ps( &ys[i],_mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+				_mm256_mul_ps( x,m01 ),_mm256_mul_ps( y,m11 ) ),_mm256_mul_ps( z,m21 ) ),ty ) );
+			_mm256_storeu_ps( &zs[i],_mm256_add_ps( _mm256_add_ps( _mm256_add_ps(
+				_mm256_mul_ps( x,m02 ),_mm256_mul_ps( y,m12 ) ),_mm256_mul_ps( z,m22 ) ),tz ) );
+		}
+#else
+		// two sse halves per step of Width
+		const __m128 m00 = _mm_set1_ps( m[0][0] ),m01 = _mm_set1_ps( m[0][1] ),m02 = _mm_set1_ps( m[0][2] );
+		const __m128 m10 = _mm_set1_ps( m[1][0] ),m11 = _mm_set1_ps( m[1][1] ),m12 = _mm_set1_ps( m[1][2] );
+		const __m128 m20 = _mm_set1_ps( m[2][0] ),m21 = _mm_set1_ps( m[2][1] ),m22 = _mm_set1_ps( m[2][2] );
+		const __m128 tx = _mm_set1_ps( translation.x );
+		const __m128 ty = _mm_set1_ps( translation.y );
+		const __m128 tz = _mm_set1_ps( translation.z );
+		for( size_t i = 0; i < end; i += 4 )
+		{
+			const __m128 x = _mm_loadu_ps( &in.xs[i] );
+			const __m128 y = _mm_loadu_ps( &in.ys[i] );
+			const __m128 z = _mm_loadu_ps( &in.zs[i] );
+			_mm_storeu_ps( &xs[i],_mm_add_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x,m00 ),_mm_mul_ps( y,m10 ) ),_mm_mul_ps( z,m20 ) ),tx ) );
+			_mm_storeu_ps( &ys[i],_mm_add_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x,m01 ),_mm_mul_ps( y,m11 ) ),_mm_mul_ps( z,m21 ) ),ty ) );
+			_mm_storeu_ps( &zs[i],_mm_add_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x,m02 ),_mm_mul_ps( y,m12 ) ),_mm_mul_ps( z,m22 ) ),tz ) );
+		}
+#endif
+	}
+private:
+	size_t count = 0u;
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> zs;
+};
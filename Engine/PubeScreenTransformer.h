@@ -15,11 +15,28 @@ public:
 		const float zInv = 1.0f / v.z;
 		v.x = (v.x * zInv + 1.0f) * xFactor;
 		v.y = (-v.y * zInv + 1.0f) * yFactor;
+		// store 1/z in z (linear in screen space, used for depth testing)
+		v.z = zInv;
 		return v;
 	}
 	Vec3 GetTransformed( const Vec3& v ) const
 	{
-		return Transform( Vec3( v ) );
+		Vec3 transformed = v;
+		return Transform( transformed );
+	}
+	// transform a whole pipeline vertex
+	// all attributes are divided by z as well, because a/z (unlike a) is linear in
+	// screen space and can be interpolated there; multiplying the interpolated
+	// value by 1 / (interpolated 1/z) recovers the perspective correct attribute
+	template<class Vertex>
+	Vertex& Transform( Vertex& v ) const
+	{
+		const float zInv = 1.0f / v.pos.z;
+		v *= zInv;
+		v.pos.x = (v.pos.x + 1.0f) * xFactor;
+		v.pos.y = (-v.pos.y + 1.0f) * yFactor;
+		v.pos.z = zInv;
+		return v;
 	}
 private:
 	float xFactor;
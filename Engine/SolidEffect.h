@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Pipeline.h"
+#include "InstanceTransform.h"
 
 // solid color attribute not interpolated
 class SolidEffect
@@ -65,6 +66,17 @@ public:
 		Vec3 pos;
 		Color color;
 	};
+	// per instance record for instanced drawing, gives each instance its own color
+	class Instance : public InstanceTransform
+	{
+	public:
+		void Apply( Vertex& v ) const
+		{
+			v.color = color;
+		}
+	public:
+		Color color;
+	};
 	// invoked for each pixel of a triangle
 	// takes an input of attributes that are the
 	// result of interpolating vertex attributes
@@ -22,15 +22,24 @@
 #include "ChiliWin.h"
 #include "Surface.h"
 #include "ChiliException.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "WorkerPool.h"
+#include "ImageEncoder.h"
+#ifdef _WIN32
 namespace Gdiplus
 {
 	using std::min;
 	using std::max;
 }
 #include <gdiplus.h>
-#include <sstream>
 
 #pragma comment( lib,"gdiplus.lib" )
+#endif
+#include <sstream>
+#include <exception>
+#include <fstream>
+#include <algorithm>
 
 void Surface::PutPixelAlpha( unsigned int x,unsigned int y,Color c )
 {
@@ -38,54 +47,144 @@ void Surface::PutPixelAlpha( unsigned int x,unsigned int y,Color c )
 	assert( y >= 0 );
 	assert( x < width );
 	assert( y < height );
-	// load source pixel
-	const Color d = GetPixel( x,y );
+	pBuffer[y * pitch + x] = AlphaBlend::BlendPixel( pBuffer[y * pitch + x],c,AlphaBlend::Mode::Straight );
+}
 
-	// blend channels
-	const unsigned char rsltRed = (c.GetR() * c.GetA() + d.GetR() * (255u - c.GetA())) / 256u;
-	const unsigned char rsltGreen = (c.GetG() * c.GetA() + d.GetG() * (255u - c.GetA())) / 256u;
-	const unsigned char rsltBlue = (c.GetB() * c.GetA() + d.GetB() * (255u - c.GetA())) / 256u;
+void Surface::Blend( int x,int y,const Surface& src,AlphaBlend::Mode mode )
+{
+	// clip the source rectangle to this surface
+	const int left = std::max( x,0 );
+	const int top = std::max( y,0 );
+	const int right = std::min( x + int( src.width ),int( width ) );
+	const int bottom = std::min( y + int( src.height ),int( height ) );
+	if( left >= right || top >= bottom )
+	{
+		return;
+	}
+	for( int dy = top; dy < bottom; dy++ )
+	{
+		BlendSpan( (unsigned int)left,(unsigned int)dy,
+			&src.pBuffer[size_t( dy - y ) * src.pitch + (left - x)],(unsigned int)( right - left ),mode );
+	}
+}
 
-	// pack channels back into pixel and fire pixel onto surface
-	PutPixel( x,y,{ rsltRed,rsltGreen,rsltBlue } );
+void Surface::PremultiplyAlpha()
+{
+	for( unsigned int y = 0; y < height; y++ )
+	{
+		AlphaBlend::Premultiply( &pBuffer[y * pitch],width );
+	}
 }
 
 Surface Surface::FromFile( const std::wstring & name )
 {
-	unsigned int width = 0;
-	unsigned int height = 0;
-	unsigned int pitch = 0;
-	std::unique_ptr<Color[]> pBuffer = nullptr;
-
+	// png, jpeg and bmp are decoded straight into the surface rows,
+	// gdi+ is left for other formats and for files the decoder rejects
+	std::wstring decoderNote;
+	try
 	{
-		Gdiplus::Bitmap bitmap( name.c_str() );
-		if( bitmap.GetLastStatus() != Gdiplus::Status::Ok )
+		const MappedFile file( name );
+		if( ImageDecoder::Identify( file.GetData(),file.GetSize() ) != ImageDecoder::Format::Unknown )
 		{
-			std::wstringstream ss;
-			ss << L"Loading image [" << name << L"]: failed to load.";
-			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+			const ImageDecoder decoder( file.GetData(),file.GetSize() );
+			Surface surface( decoder.GetWidth(),decoder.GetHeight() );
+			decoder.Decode( surface.GetBufferPtr(),surface.pitch );
+			return surface;
 		}
+	}
+	catch( const ImageDecoder::Exception& e )
+	{
+		decoderNote = L" " + e.GetNote();
+	}
+	catch( const MappedFile::Exception& e )
+	{
+		decoderNote = L" " + e.GetNote();
+	}
+
+#ifndef _WIN32
+	std::wstringstream ss;
+	ss << L"Loading image [" << name << L"]: failed to load." << decoderNote;
+	throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+#else
+	Gdiplus::Bitmap bitmap( name.c_str() );
+	if( bitmap.GetLastStatus() != Gdiplus::Status::Ok )
+	{
+		std::wstringstream ss;
+		ss << L"Loading image [" << name << L"]: failed to load." << decoderNote;
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+	}
 
-		pitch = width = bitmap.GetWidth();
-		height = bitmap.GetHeight();
-		pBuffer = std::make_unique<Color[]>( width * height );
+	Surface surface( bitmap.GetWidth(),bitmap.GetHeight() );
 
-		for( unsigned int y = 0; y < height; y++ )
+	// let gdi+ convert the whole image into our buffer in one go
+	Gdiplus::Rect rect( 0,0,int( surface.width ),int( surface.height ) );
+	Gdiplus::BitmapData data;
+	data.Width = surface.width;
+	data.Height = surface.height;
+	data.Stride = int( surface.pitch * sizeof( Color ) );
+	data.PixelFormat = PixelFormat32bppARGB;
+	data.Scan0 = surface.GetBufferPtr();
+	data.Reserved = 0;
+	if( bitmap.LockBits( &rect,Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+		PixelFormat32bppARGB,&data ) != Gdiplus::Status::Ok )
+	{
+		std::wstringstream ss;
+		ss << L"Loading image [" << name << L"]: failed to read pixels.";
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+	}
+	bitmap.UnlockBits( &data );
+
+	return surface;
+#endif
+}
+
+std::vector<Surface> Surface::FromFiles( const std::vector<std::wstring>& names )
+{
+	// one file per work item, errors are rethrown here in file order
+	std::vector<std::unique_ptr<Surface>> loaded( names.size() );
+	std::vector<std::exception_ptr> errors( names.size() );
+	{
+		WorkerPool pool( (unsigned int)std::min( names.size(),size_t( std::thread::hardware_concurrency() ) ) );
+		pool.ParallelFor( names.size(),[&]( size_t i )
 		{
-			for( unsigned int x = 0; x < width; x++ )
+			try
 			{
-				Gdiplus::Color c;
-				bitmap.GetPixel( x,y,&c );
-				pBuffer[y * pitch + x] = c.GetValue();
+				loaded[i] = std::make_unique<Surface>( FromFile( names[i] ) );
 			}
+			catch( ... )
+			{
+				errors[i] = std::current_exception();
+			}
+		} );
+	}
+	std::vector<Surface> surfaces;
+	surfaces.reserve( names.size() );
+	for( size_t i = 0; i < names.size(); i++ )
+	{
+		if( errors[i] )
+		{
+			std::rethrow_exception( errors[i] );
 		}
+		surfaces.push_back( std::move( *loaded[i] ) );
 	}
-
-	return Surface( width,height,pitch,std::move( pBuffer ) );
+	return surfaces;
 }
 
 void Surface::Save( const std::wstring & filename ) const
 {
+#ifndef _WIN32
+	// no gdi+, written as png (wide names are expected to be ascii here)
+	std::vector<unsigned char> encoded;
+	ImageEncoder::EncodePng( pBuffer.get(),pitch,width,height,encoded );
+	std::ofstream file( std::string( filename.begin(),filename.end() ),std::ios::binary | std::ios::trunc );
+	file.write( reinterpret_cast<const char*>( encoded.data() ),std::streamsize( encoded.size() ) );
+	if( !file )
+	{
+		std::wstringstream ss;
+		ss << L"Saving surface to [" << filename << L"]: failed to save.";
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+	}
+#else
 	auto GetEncoderClsid = [&filename]( const WCHAR* format,CLSID* pClsid ) -> void
 	{
 		UINT  num = 0;          // number of image encoders
@@ -137,6 +236,7 @@ void Surface::Save( const std::wstring & filename ) const
 		ss << L"Saving surface to [" << filename << L"]: failed to save.";
 		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
 	}
+#endif
 }
 
 void Surface::Copy( const Surface & src )
@@ -145,13 +245,13 @@ void Surface::Copy( const Surface & src )
 	assert( height == src.height );
 	if( pitch == src.pitch )
 	{
-		memcpy( pBuffer.get(),src.pBuffer.get(),pitch * height * sizeof( Color ) );
+		std::copy_n( src.pBuffer.get(),size_t( pitch ) * height,pBuffer.get() );
 	}
 	else
 	{
 		for( unsigned int y = 0; y < height; y++ )
 		{
-			memcpy( &pBuffer[pitch * y],&src.pBuffer[pitch * y],sizeof( Color )* width );
+			std::copy_n( &src.pBuffer[src.pitch * y],width,&pBuffer[pitch * y] );
 		}
 	}
 }
@@ -23,9 +23,14 @@
 #include "Colors.h"
 #include "Rect.h"
 #include "ChiliException.h"
+#include "AlphaBlend.h"
+#include "AlignedBuffer.h"
 #include <string>
 #include <assert.h>
 #include <memory>
+#include <algorithm>
+#include <vector>
+#include <cstring>
 
 
 class Surface
@@ -39,16 +44,29 @@ public:
 		virtual std::wstring GetExceptionType() const override { return L"Surface Exception"; }
 	};
 public:
-	Surface( unsigned int width,unsigned int height,unsigned int pitch )
+	// rows start on a cache line when the pitch is padded (see GetPitch), so the default
+	// constructor does that, and the buffer itself is always cache line aligned
+	static constexpr unsigned int RowAlignment = (unsigned int)AlignedBuffer::CacheLine;
+	enum class Allocation
+	{
+		Normal,
+		// for large render targets, falls back to normal pages if the os refuses
+		HugePages
+	};
+public:
+	Surface( unsigned int width,unsigned int height,unsigned int pitch,Allocation allocation = Allocation::Normal )
 		:
-		pBuffer( std::make_unique<Color[]>( pitch * height ) ),
+		pBuffer( AlignedBuffer::Allocate<Color>( size_t( pitch ) * height,AlignedBuffer::CacheLine,
+			allocation == Allocation::HugePages ) ),
 		width( width ),
 		height( height ),
 		pitch( pitch )
-	{}
-	Surface( unsigned int width,unsigned int height )
+	{
+		assert( pitch >= width );
+	}
+	Surface( unsigned int width,unsigned int height,Allocation allocation = Allocation::Normal )
 		:
-		Surface( width,height,width )
+		Surface( width,height,GetPitch( width,RowAlignment ),allocation )
 	{}
 	Surface( Surface&& source )
 		:
@@ -72,7 +90,8 @@ public:
 	{}
 	void Clear( Color fillValue  )
 	{
-		memset( pBuffer.get(),fillValue.dword,pitch * height * sizeof( Color ) );
+		// (memset would only work for colors with 4 equal bytes)
+		std::fill_n( pBuffer.get(),size_t( pitch ) * height,fillValue );
 	}
 	void Present( unsigned int dstPitch,BYTE* const pDst ) const
 	{
@@ -90,6 +109,18 @@ public:
 		pBuffer[y * pitch + x] = c;
 	}
 	void PutPixelAlpha( unsigned int x,unsigned int y,Color c );
+	// blends count pixels of pSrc over row y starting at x (the span must fit in the row)
+	void BlendSpan( unsigned int x,unsigned int y,const Color* pSrc,unsigned int count,
+		AlphaBlend::Mode mode = AlphaBlend::Mode::Straight )
+	{
+		assert( x + count <= width );
+		assert( y < height );
+		AlphaBlend::BlendSpan( &pBuffer[y * pitch + x],pSrc,count,mode );
+	}
+	// blends all of src with its top left corner at (x,y), clipped to this surface
+	void Blend( int x,int y,const Surface& src,AlphaBlend::Mode mode = AlphaBlend::Mode::Straight );
+	// turns straight alpha into premultiplied (for blending with AlphaBlend::Mode::Premultiplied)
+	void PremultiplyAlpha();
 	Color GetPixel( unsigned int x,unsigned int y ) const
 	{
 		assert( x >= 0 );
@@ -118,7 +149,11 @@ public:
 	{
 		return pBuffer.get();
 	}
+	// png, jpeg and bmp anywhere, other formats through gdi+ on windows
 	static Surface FromFile( const std::wstring& name );
+	// loads the files in parallel (surfaces come back in the order of the names)
+	static std::vector<Surface> FromFiles( const std::vector<std::wstring>& names );
+	// bmp through gdi+ on windows, png elsewhere
 	void Save( const std::wstring& filename ) const;
 	void Copy( const Surface& src );
 private:
@@ -129,15 +164,8 @@ private:
 		const unsigned int pixelAlignment = byteAlignment / sizeof( Color );
 		return width + ( pixelAlignment - width % pixelAlignment ) % pixelAlignment;
 	}
-	Surface( unsigned int width,unsigned int height,unsigned int pitch,std::unique_ptr<Color[]> pBufferParam )
-		:
-		width( width ),
-		height( height ),
-		pBuffer( std::move( pBufferParam ) ),
-		pitch( pitch )
-	{}
 private:
-	std::unique_ptr<Color[]> pBuffer;
+	AlignedBuffer::Pointer<Color> pBuffer;
 	unsigned int width;
 	unsigned int height;
 	unsigned int pitch; // pitch is in PIXELS, not bytes!
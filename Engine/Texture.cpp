@@ -0,0 +1,927 @@
+#include "Texture.h"
+#include "ChiliMath.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+
+namespace
+{
+	// per channel a + (b - a) * weight / 256, for all four bytes of the colors
+	// (two channels per multiply)
+	Color LerpColor( Color a,Color b,unsigned int weight )
+	{
+		const unsigned int wb = weight;
+		const unsigned int wa = 256u - wb;
+		const unsigned int rb = (((a.dword & 0x00FF00FFu) * wa + (b.dword & 0x00FF00FFu) * wb) >> 8u) & 0x00FF00FFu;
+		const unsigned int xg = (((a.dword >> 8u) & 0x00FF00FFu) * wa + ((b.dword >> 8u) & 0x00FF00FFu) * wb) & 0xFF00FF00u;
+		return rb | xg;
+	}
+	// weight of end color 1 for each bc1 index (8 bit fixed point), in the 3 color mode
+	// (color 0 <= color 1) and the 4 color mode, index 3 of the 3 color mode is transparent
+	const unsigned int bc1Weights[2][4] = { { 0u,256u,128u,0u },{ 0u,256u,85u,171u } };
+	// 565 to 888, the top bits of each channel are repeated in the low ones
+	Color Expand565( unsigned int c )
+	{
+		return ((c & 0xF800u) << 8u) | ((c & 0xE000u) << 3u) |
+			((c & 0x07E0u) << 5u) | ((c & 0x0600u) >> 1u) |
+			((c & 0x001Fu) << 3u) | ((c & 0x001Cu) >> 2u);
+	}
+	Color DecodeBc1( unsigned int ends,unsigned int index )
+	{
+		const unsigned int e0 = ends & 0xFFFFu;
+		const unsigned int e1 = ends >> 16u;
+		const bool fourColors = e0 > e1;
+		if( !fourColors && index == 3u )
+		{
+			return Color( 0u );
+		}
+		return Color( LerpColor( Expand565( e0 ),Expand565( e1 ),bc1Weights[fourColors][index] ).dword | 0xFF000000u );
+	}
+
+	// bc1 block encoder
+	// end colors start at the extremes of the texels along their principal axis,
+	// then get refitted to the chosen indices by least squares (keeping whichever is better)
+	class Bc1Encoder
+	{
+	public:
+		// texels row by row, returns the two block words
+		static void Encode( const Color* pTexels,unsigned int& ends,unsigned int& indices )
+		{
+			bool transparent = false;
+			float mean[3] = { 0.0f,0.0f,0.0f };
+			unsigned int nOpaque = 0u;
+			for( unsigned int i = 0u; i < 16u; i++ )
+			{
+				if( pTexels[i].GetA() < 128u )
+				{
+					transparent = true;
+					continue;
+				}
+				mean[0] += pTexels[i].GetR();
+				mean[1] += pTexels[i].GetG();
+				mean[2] += pTexels[i].GetB();
+				nOpaque++;
+			}
+			if( nOpaque == 0u )
+			{
+				// 3 color mode, all index 3
+				ends = 0u;
+				indices = 0xFFFFFFFFu;
+				return;
+			}
+			for( float& m : mean )
+			{
+				m /= float( nOpaque );
+			}
+			float cov[3][3] = {};
+			for( unsigned int i = 0u; i < 16u; i++ )
+			{
+				if( pTexels[i].GetA() < 128u )
+				{
+					continue;
+				}
+				const float d[3] = { pTexels[i].GetR() - mean[0],pTexels[i].GetG() - mean[1],pTexels[i].GetB() - mean[2] };
+				for( int r = 0; r < 3; r++ )
+				{
+					for( int c = 0; c < 3; c++ )
+					{
+						cov[r][c] += d[r] * d[c];
+					}
+				}
+			}
+			// principal axis by power iteration
+			float axis[3] = { 1.0f,1.0f,1.0f };
+			for( int iteration = 0; iteration < 8; iteration++ )
+			{
+				float next[3];
+				for( int r = 0; r < 3; r++ )
+				{
+					next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2];
+				}
+				const float length = std::sqrt( next[0] * next[0] + next[1] * next[1] + next[2] * next[2] );
+				if( length < 1e-6f )
+				{
+					break;
+				}
+				for( int r = 0; r < 3; r++ )
+				{
+					axis[r] = next[r] / length;
+				}
+			}
+			float minT = 0.0f;
+			float maxT = 0.0f;
+			for( unsigned int i = 0u; i < 16u; i++ )
+			{
+				if( pTexels[i].GetA() >= 128u )
+				{
+					const float t = (pTexels[i].GetR() - mean[0]) * axis[0] +
+						(pTexels[i].GetG() - mean[1]) * axis[1] + (pTexels[i].GetB() - mean[2]) * axis[2];
+					minT = std::min( minT,t );
+					maxT = std::max( maxT,t );
+				}
+			}
+			unsigned int bestIndices;
+			unsigned int bestEnds = OrderEnds(
+				To565( mean[0] + axis[0] * maxT,mean[1] + axis[1] * maxT,mean[2] + axis[2] * maxT ),
+				To565( mean[0] + axis[0] * minT,mean[1] + axis[1] * minT,mean[2] + axis[2] * minT ),transparent );
+			unsigned int bestError = ChooseIndices( pTexels,bestEnds,bestIndices );
+			for( int iteration = 0; iteration < 2 && bestError > 0u; iteration++ )
+			{
+				unsigned int refitEnds;
+				if( !Refit( pTexels,bestEnds,bestIndices,transparent,refitEnds ) )
+				{
+					break;
+				}
+				unsigned int refitIndices;
+				const unsigned int refitError = ChooseIndices( pTexels,refitEnds,refitIndices );
+				if( refitError >= bestError )
+				{
+					break;
+				}
+				bestEnds = refitEnds;
+				bestIndices = refitIndices;
+				bestError = refitError;
+			}
+			ends = bestEnds;
+			indices = bestIndices;
+		}
+	private:
+		static unsigned int To565( float r,float g,float b )
+		{
+			const auto quantize = []( float v,float levels )
+			{
+				return (unsigned int)(std::min( std::max( v,0.0f ),255.0f ) * levels / 255.0f + 0.5f);
+			};
+			return (quantize( r,31.0f ) << 11u) | (quantize( g,63.0f ) << 5u) | quantize( b,31.0f );
+		}
+		// the order of the end colors selects the mode (equal ends decode as 3 colors)
+		static unsigned int OrderEnds( unsigned int c0,unsigned int c1,bool threeColors )
+		{
+			const unsigned int hi = std::max( c0,c1 );
+			const unsigned int lo = std::min( c0,c1 );
+			return threeColors ? (lo | (hi << 16u)) : (hi | (lo << 16u));
+		}
+		// nearest palette color for each texel, returns the squared error
+		static unsigned int ChooseIndices( const Color* pTexels,unsigned int ends,unsigned int& indices )
+		{
+			Color palette[4];
+			for( unsigned int i = 0u; i < 4u; i++ )
+			{
+				palette[i] = DecodeBc1( ends,i );
+			}
+			const unsigned int nColors = (ends & 0xFFFFu) > (ends >> 16u) ? 4u : 3u;
+			unsigned int error = 0u;
+			indices = 0u;
+			for( unsigned int i = 0u; i < 16u; i++ )
+			{
+				const Color c = pTexels[i];
+				if( c.GetA() < 128u )
+				{
+					indices |= 3u << (i * 2u);
+					continue;
+				}
+				unsigned int best = 0u;
+				unsigned int bestDist = ~0u;
+				for( unsigned int j = 0u; j < nColors; j++ )
+				{
+					const int dr = int( c.GetR() ) - int( palette[j].GetR() );
+					const int dg = int( c.GetG() ) - int( palette[j].GetG() );
+					const int db = int( c.GetB() ) - int( palette[j].GetB() );
+					const unsigned int dist = (unsigned int)( dr * dr + dg * dg + db * db );
+					if( dist < bestDist )
+					{
+						best = j;
+						bestDist = dist;
+					}
+				}
+				indices |= best << (i * 2u);
+				error += bestDist;
+			}
+			return error;
+		}
+		// least squares end colors for the given indices, false if they do not pin them down
+		static bool Refit( const Color* pTexels,unsigned int ends,unsigned int indices,bool transparent,unsigned int& refitEnds )
+		{
+			const bool fourColors = (ends & 0xFFFFu) > (ends >> 16u);
+			float aa = 0.0f;
+			float ab = 0.0f;
+			float bb = 0.0f;
+			float ax[3] = { 0.0f,0.0f,0.0f };
+			float bx[3] = { 0.0f,0.0f,0.0f };
+			for( unsigned int i = 0u; i < 16u; i++ )
+			{
+				if( pTexels[i].GetA() < 128u )
+				{
+					continue;
+				}
+				const float t = float( bc1Weights[fourColors][(indices >> (i * 2u)) & 3u] ) / 256.0f;
+				const float s = 1.0f - t;
+				const float p[3] = { float( pTexels[i].GetR() ),float( pTexels[i].GetG() ),float( pTexels[i].GetB() ) };
+				aa += s * s;
+				ab += s * t;
+				bb += t * t;
+				for( int c = 0; c < 3; c++ )
+				{
+					ax[c] += s * p[c];
+					bx[c] += t * p[c];
+				}
+			}
+			const float det = aa * bb - ab * ab;
+			if( std::abs( det ) < 1e-4f )
+			{
+				return false;
+			}
+			float a[3];
+			float b[3];
+			for( int c = 0; c < 3; c++ )
+			{
+				a[c] = (bb * ax[c] - ab * bx[c]) / det;
+				b[c] = (aa * bx[c] - ab * ax[c]) / det;
+			}
+			refitEnds = OrderEnds( To565( a[0],a[1],a[2] ),To565( b[0],b[1],b[2] ),transparent );
+			return true;
+		}
+	};
+
+	// spreads the 6 bits of v to the even bits of the result (for morton codes)
+	struct MortonTable
+	{
+		MortonTable()
+		{
+			for( unsigned int v = 0u; v < 64u; v++ )
+			{
+				unsigned int spread = 0u;
+				for( unsigned int bit = 0u; bit < 6u; bit++ )
+				{
+					spread |= ((v >> bit) & 1u) << (bit * 2u);
+				}
+				spreadBits[v] = (unsigned short)spread;
+			}
+		}
+		unsigned short spreadBits[64];
+	};
+	const MortonTable mortonTable;
+
+	// baked texture file: header, level table, then the texels of each level (64 byte aligned)
+	// native byte order, it is a cache for the machine that wrote it
+	struct BakedHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t layout;
+		uint32_t nLevels;
+		// size and last write time of the image it was baked from
+		uint64_t sourceSize;
+		int64_t sourceWriteTime;
+	};
+	struct BakedLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t tilesPerRow;
+		uint32_t pad;
+		// in bytes from the start of the file
+		uint64_t offset;
+		// in texels
+		uint64_t count;
+	};
+	constexpr char bakedMagic[4] = { 'C','T','E','X' };
+	constexpr uint32_t bakedVersion = 1u;
+	constexpr uint32_t maxBakedLevels = 32u;
+	constexpr uint64_t bakedAlignment = 64u;
+
+	uint64_t AlignBaked( uint64_t offset )
+	{
+		return (offset + bakedAlignment - 1u) & ~(bakedAlignment - 1u);
+	}
+	// reads the header, nullptr if the file is not a baked texture of this version
+	const BakedHeader* GetBakedHeader( const MappedFile& file )
+	{
+		if( file.GetSize() < sizeof( BakedHeader ) )
+		{
+			return nullptr;
+		}
+		const auto pHeader = reinterpret_cast<const BakedHeader*>( file.GetData() );
+		if( std::memcmp( pHeader->magic,bakedMagic,sizeof( bakedMagic ) ) != 0 ||
+			pHeader->version != bakedVersion )
+		{
+			return nullptr;
+		}
+		return pHeader;
+	}
+	// part of the baked file name, so every layout of an image has its own cache
+	const wchar_t* GetLayoutName( Texture::Layout layout )
+	{
+		switch( layout )
+		{
+		case Texture::Layout::Tiled:
+			return L"tiled";
+		case Texture::Layout::Morton:
+			return L"morton";
+		case Texture::Layout::Bc1:
+			return L"bc1";
+		default:
+			return L"linear";
+		}
+	}
+}
+
+size_t Texture::LinearAddress::Index( const Level& level,unsigned int x,unsigned int y )
+{
+	return size_t( y ) * level.width + x;
+}
+
+unsigned int Texture::LinearAddress::GetTilesPerRow( unsigned int width )
+{
+	return width;
+}
+
+size_t Texture::LinearAddress::GetStorageSize( unsigned int width,unsigned int height )
+{
+	return size_t( width ) * height;
+}
+
+size_t Texture::TiledAddress::Index( const Level& level,unsigned int x,unsigned int y )
+{
+	const size_t tile = size_t( y / TileSize ) * level.tilesPerRow + x / TileSize;
+	return tile * (TileSize * TileSize) + (y % TileSize) * TileSize + x % TileSize;
+}
+
+unsigned int Texture::TiledAddress::GetTilesPerRow( unsigned int width )
+{
+	return (width + TileSize - 1u) / TileSize;
+}
+
+size_t Texture::TiledAddress::GetStorageSize( unsigned int width,unsigned int height )
+{
+	return size_t( GetTilesPerRow( width ) ) * GetTilesPerRow( height ) * (TileSize * TileSize);
+}
+
+size_t Texture::MortonAddress::Index( const Level& level,unsigned int x,unsigned int y )
+{
+	const size_t block = size_t( y / BlockSize ) * level.tilesPerRow + x / BlockSize;
+	return block * (BlockSize * BlockSize) +
+		mortonTable.spreadBits[x % BlockSize] + (mortonTable.spreadBits[y % BlockSize] << 1u);
+}
+
+unsigned int Texture::MortonAddress::GetTilesPerRow( unsigned int width )
+{
+	return (width + BlockSize - 1u) / BlockSize;
+}
+
+size_t Texture::MortonAddress::GetStorageSize( unsigned int width,unsigned int height )
+{
+	return size_t( GetTilesPerRow( width ) ) * GetTilesPerRow( height ) * (BlockSize * BlockSize);
+}
+
+Color Texture::Bc1Address::Fetch( const Level& level,unsigned int x,unsigned int y )
+{
+	const Color* const pBlock = level.texels + (size_t( y / BlockSize ) * level.tilesPerRow + x / BlockSize) * 2u;
+	const unsigned int shift = ((y % BlockSize) * BlockSize + x % BlockSize) * 2u;
+	return DecodeBc1( pBlock[0].dword,(pBlock[1].dword >> shift) & 3u );
+}
+
+unsigned int Texture::Bc1Address::GetTilesPerRow( unsigned int width )
+{
+	return (width + BlockSize - 1u) / BlockSize;
+}
+
+size_t Texture::Bc1Address::GetStorageSize( unsigned int width,unsigned int height )
+{
+	// two words per block
+	return size_t( GetTilesPerRow( width ) ) * GetTilesPerRow( height ) * 2u;
+}
+
+Texture::Texture( const Surface& base,Layout layout_in )
+{
+	// each level halves the size, down to 1x1
+	size_t nLevels = 1u;
+	for( unsigned int size = std::max( base.GetWidth(),base.GetHeight() ); size > 1u; size /= 2u )
+	{
+		nLevels++;
+	}
+	levels.reserve( nLevels );
+
+	Level top;
+	top.width = base.GetWidth();
+	top.height = base.GetHeight();
+	top.tilesPerRow = LinearAddress::GetTilesPerRow( top.width );
+	top.storage.resize( LinearAddress::GetStorageSize( top.width,top.height ) );
+	for( unsigned int y = 0u; y < top.height; y++ )
+	{
+		for( unsigned int x = 0u; x < top.width; x++ )
+		{
+			top.storage[LinearAddress::Index( top,x,y )] = base.GetPixel( x,y );
+		}
+	}
+	top.UseStorage();
+	levels.push_back( std::move( top ) );
+	while( levels.size() < nLevels )
+	{
+		levels.push_back( Downsample( levels.back() ) );
+	}
+	SetLayout( layout_in );
+}
+
+Texture Texture::FromFile( const std::wstring& filename,Layout layout )
+{
+	return Texture( Surface::FromFile( filename ),layout );
+}
+
+std::vector<Texture> Texture::FromFiles( const std::vector<std::wstring>& filenames,Layout layout )
+{
+	// one file per work item, errors are rethrown here in file order
+	std::vector<std::unique_ptr<Texture>> loaded( filenames.size() );
+	std::vector<std::exception_ptr> errors( filenames.size() );
+	{
+		WorkerPool pool( (unsigned int)std::min( filenames.size(),size_t( std::thread::hardware_concurrency() ) ) );
+		pool.ParallelFor( filenames.size(),[&]( size_t i )
+		{
+			try
+			{
+				loaded[i] = std::make_unique<Texture>( FromFile( filenames[i],layout ) );
+			}
+			catch( ... )
+			{
+				errors[i] = std::current_exception();
+			}
+		} );
+	}
+	std::vector<Texture> textures;
+	textures.reserve( filenames.size() );
+	for( size_t i = 0u; i < filenames.size(); i++ )
+	{
+		if( errors[i] )
+		{
+			std::rethrow_exception( errors[i] );
+		}
+		textures.push_back( std::move( *loaded[i] ) );
+	}
+	return textures;
+}
+
+std::wstring Texture::GetBakedName( const std::wstring& filename,Layout layout )
+{
+	return filename + L"." + GetLayoutName( layout ) + L".tex";
+}
+
+Texture Texture::Bake( const std::wstring& filename,Layout layout )
+{
+	// stamp before decoding, so an image replaced meanwhile makes the cache stale, not wrong
+	uint64_t sourceSize = 0u;
+	int64_t sourceWriteTime = 0;
+	if( !MappedFile::GetFileInfo( filename,sourceSize,sourceWriteTime ) )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,L"Cannot read image file: " + filename );
+	}
+	Texture texture = FromFile( filename,layout );
+	texture.WriteBaked( GetBakedName( filename,layout ),sourceSize,sourceWriteTime );
+	return texture;
+}
+
+Texture Texture::FromBakedFile( const std::wstring& bakedFilename )
+{
+	try
+	{
+		return Texture( std::make_unique<MappedFile>( bakedFilename ) );
+	}
+	catch( const MappedFile::Exception& e )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,e.GetNote() );
+	}
+}
+
+Texture Texture::FromFileCached( const std::wstring& filename,Layout layout )
+{
+	uint64_t sourceSize = 0u;
+	int64_t sourceWriteTime = 0;
+	const bool haveSource = MappedFile::GetFileInfo( filename,sourceSize,sourceWriteTime );
+	const std::wstring bakedName = GetBakedName( filename,layout );
+	// use the cache only if it was baked from this very image in this layout
+	// (without the image, any valid cache will do)
+	try
+	{
+		auto pFile = std::make_unique<MappedFile>( bakedName );
+		const BakedHeader* pHeader = GetBakedHeader( *pFile );
+		if( pHeader && pHeader->layout == uint32_t( layout ) &&
+			(!haveSource || (pHeader->sourceSize == sourceSize && pHeader->sourceWriteTime == sourceWriteTime)) )
+		{
+			return Texture( std::move( pFile ) );
+		}
+	}
+	catch( const MappedFile::Exception& )
+	{
+		// no cache yet
+	}
+	catch( const Exception& )
+	{
+		// damaged cache, bake it again
+	}
+	Texture texture = FromFile( filename,layout );
+	if( haveSource )
+	{
+		try
+		{
+			texture.WriteBaked( bakedName,sourceSize,sourceWriteTime );
+		}
+		catch( const MappedFile::Exception& )
+		{
+			// read only location (or the old cache is still mapped on windows),
+			// the texture is fine without a cache
+		}
+	}
+	return texture;
+}
+
+Texture::Texture( std::unique_ptr<MappedFile> pMapping_in )
+	:
+	pMapping( std::move( pMapping_in ) )
+{
+	const std::wstring note = L"Invalid baked texture file";
+	const BakedHeader* pHeader = GetBakedHeader( *pMapping );
+	if( !pHeader || pHeader->layout > uint32_t( Layout::Bc1 ) ||
+		pHeader->nLevels == 0u || pHeader->nLevels > maxBakedLevels )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,note );
+	}
+	const uint64_t fileSize = pMapping->GetSize();
+	if( sizeof( BakedHeader ) + uint64_t( pHeader->nLevels ) * sizeof( BakedLevel ) > fileSize )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,note );
+	}
+	layout = Layout( pHeader->layout );
+	const auto pTable = reinterpret_cast<const BakedLevel*>( pMapping->GetData() + sizeof( BakedHeader ) );
+	levels.reserve( pHeader->nLevels );
+	for( uint32_t i = 0u; i < pHeader->nLevels; i++ )
+	{
+		const BakedLevel& entry = pTable[i];
+		// each level is half the one above (rounded down, at least 1)
+		const bool sizeOk = i == 0u ?
+			(entry.width > 0u && entry.height > 0u && entry.width <= 0x10000u && entry.height <= 0x10000u) :
+			(entry.width == std::max( levels.back().width / 2u,1u ) &&
+				entry.height == std::max( levels.back().height / 2u,1u ));
+		if( !sizeOk ||
+			entry.count != GetStorageSize( layout,entry.width,entry.height ) ||
+			entry.offset % bakedAlignment != 0u || entry.offset > fileSize ||
+			entry.count > (fileSize - entry.offset) / sizeof( Color ) )
+		{
+			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,note );
+		}
+		Level level;
+		level.width = entry.width;
+		level.height = entry.height;
+		switch( layout )
+		{
+		case Layout::Linear:
+			level.tilesPerRow = LinearAddress::GetTilesPerRow( level.width );
+			break;
+		case Layout::Tiled:
+			level.tilesPerRow = TiledAddress::GetTilesPerRow( level.width );
+			break;
+		case Layout::Morton:
+			level.tilesPerRow = MortonAddress::GetTilesPerRow( level.width );
+			break;
+		default:
+			level.tilesPerRow = Bc1Address::GetTilesPerRow( level.width );
+			break;
+		}
+		if( entry.tilesPerRow != level.tilesPerRow )
+		{
+			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,note );
+		}
+		level.texels = reinterpret_cast<const Color*>( pMapping->GetData() + entry.offset );
+		levels.push_back( std::move( level ) );
+	}
+	// the chain must go down to 1x1
+	if( levels.back().width != 1u || levels.back().height != 1u )
+	{
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,note );
+	}
+}
+
+void Texture::WriteBaked( const std::wstring& bakedFilename,uint64_t sourceSize,int64_t sourceWriteTime ) const
+{
+	const uint64_t tableEnd = sizeof( BakedHeader ) + uint64_t( levels.size() ) * sizeof( BakedLevel );
+	std::vector<BakedLevel> table( levels.size() );
+	uint64_t fileSize = AlignBaked( tableEnd );
+	for( size_t i = 0u; i < levels.size(); i++ )
+	{
+		const Level& level = levels[i];
+		table[i].width = level.width;
+		table[i].height = level.height;
+		table[i].tilesPerRow = level.tilesPerRow;
+		table[i].pad = 0u;
+		table[i].offset = fileSize;
+		table[i].count = GetStorageSize( layout,level.width,level.height );
+		fileSize = AlignBaked( fileSize + table[i].count * sizeof( Color ) );
+	}
+	// written to a new file that then replaces the old one, textures still mapped from the
+	// old one keep its pages (truncating it in place would pull them out from under them)
+	const std::wstring tempFilename = bakedFilename + L".tmp";
+	{
+		// written straight into the mapped file, the header last so a cut off file is not valid
+		MappedFile file( tempFilename,size_t( fileSize ) );
+		unsigned char* const pData = file.GetWritableData();
+		std::memcpy( pData + sizeof( BakedHeader ),table.data(),table.size() * sizeof( BakedLevel ) );
+		for( size_t i = 0u; i < levels.size(); i++ )
+		{
+			std::memcpy( pData + table[i].offset,levels[i].texels,size_t( table[i].count ) * sizeof( Color ) );
+		}
+		BakedHeader header;
+		std::memcpy( header.magic,bakedMagic,sizeof( bakedMagic ) );
+		header.version = bakedVersion;
+		header.layout = uint32_t( layout );
+		header.nLevels = uint32_t( levels.size() );
+		header.sourceSize = sourceSize;
+		header.sourceWriteTime = sourceWriteTime;
+		std::memcpy( pData,&header,sizeof( header ) );
+	}
+	MappedFile::Replace( tempFilename,bakedFilename );
+}
+
+void Texture::SetLayout( Layout layout_in )
+{
+	if( layout_in == layout )
+	{
+		return;
+	}
+	for( auto& level : levels )
+	{
+		switch( layout_in )
+		{
+		case Layout::Linear:
+			level = Reorder<LinearAddress>( level,layout );
+			break;
+		case Layout::Tiled:
+			level = Reorder<TiledAddress>( level,layout );
+			break;
+		case Layout::Morton:
+			level = Reorder<MortonAddress>( level,layout );
+			break;
+		default:
+			// the encoder reads linear texels
+			level = layout == Layout::Linear ? EncodeBc1( level ) : EncodeBc1( Reorder<LinearAddress>( level,layout ) );
+			break;
+		}
+	}
+	layout = layout_in;
+	// every level owns its texels now
+	pMapping.reset();
+}
+
+size_t Texture::GetStorageSize( Layout layout,unsigned int width,unsigned int height )
+{
+	switch( layout )
+	{
+	case Layout::Linear:
+		return LinearAddress::GetStorageSize( width,height );
+	case Layout::Tiled:
+		return TiledAddress::GetStorageSize( width,height );
+	case Layout::Morton:
+		return MortonAddress::GetStorageSize( width,height );
+	default:
+		return Bc1Address::GetStorageSize( width,height );
+	}
+}
+
+Texture::Layout Texture::GetLayout() const
+{
+	return layout;
+}
+
+float Texture::ComputeLod( const Vec2& ddx,const Vec2& ddy ) const
+{
+	// pixel footprint along x and y in base level texels
+	const float w = float( GetWidth() );
+	const float h = float( GetHeight() );
+	const float lenSqX = sq( ddx.x * w ) + sq( ddx.y * h );
+	const float lenSqY = sq( ddy.x * w ) + sq( ddy.y * h );
+	// log2( sqrt( x ) ) = 0.5 * log2( x )
+	return 0.5f * std::log2( std::max( std::max( lenSqX,lenSqY ),1e-12f ) );
+}
+
+Color Texture::Sample( const Vec2& t,float lod,Filter filter ) const
+{
+	// pick the addressing once per sample, not per texel
+	switch( layout )
+	{
+	case Layout::Linear:
+		return SampleLayout<LinearAddress>( t,lod,filter );
+	case Layout::Tiled:
+		return SampleLayout<TiledAddress>( t,lod,filter );
+	case Layout::Morton:
+		return SampleLayout<MortonAddress>( t,lod,filter );
+	default:
+		return SampleLayout<Bc1Address>( t,lod,filter );
+	}
+}
+
+size_t Texture::GetLevelCount() const
+{
+	return levels.size();
+}
+
+unsigned int Texture::GetLevelWidth( size_t level ) const
+{
+	return levels[level].width;
+}
+
+unsigned int Texture::GetLevelHeight( size_t level ) const
+{
+	return levels[level].height;
+}
+
+Color Texture::GetTexel( size_t level,unsigned int x,unsigned int y ) const
+{
+	const Level& l = levels[level];
+	assert( x < l.width );
+	assert( y < l.height );
+	return FetchTexel( l,layout,x,y );
+}
+
+unsigned int Texture::GetWidth() const
+{
+	return levels.front().width;
+}
+
+unsigned int Texture::GetHeight() const
+{
+	return levels.front().height;
+}
+
+size_t Texture::GetByteSize() const
+{
+	size_t size = 0u;
+	for( const auto& level : levels )
+	{
+		size += GetStorageSize( layout,level.width,level.height ) * sizeof( Color );
+	}
+	return size;
+}
+
+template<class Address>
+Color Texture::SampleLayout( const Vec2& t,float lod,Filter filter ) const
+{
+	const float maxLevel = float( levels.size() - 1u );
+	lod = std::min( std::max( lod,0.0f ),maxLevel );
+	switch( filter )
+	{
+	case Filter::Point:
+		return SamplePoint<Address>( levels[size_t( lod + 0.5f )],t );
+	case Filter::Bilinear:
+		return SampleBilinear<Address>( levels[size_t( lod + 0.5f )],t );
+	default:
+	{
+		const size_t level = size_t( lod );
+		const float fraction = lod - float( level );
+		const Color fine = SampleBilinear<Address>( levels[level],t );
+		if( fraction == 0.0f )
+		{
+			return fine;
+		}
+		return LerpColor( fine,SampleBilinear<Address>( levels[level + 1u],t ),
+			(unsigned int)(fraction * 256.0f + 0.5f) );
+	}
+	}
+}
+
+template<class Address>
+Color Texture::SamplePoint( const Level& level,const Vec2& t )
+{
+	const int xMax = int( level.width ) - 1;
+	const int yMax = int( level.height ) - 1;
+	const int x = std::min( std::max( int( t.x * float( level.width ) ),0 ),xMax );
+	const int y = std::min( std::max( int( t.y * float( level.height ) ),0 ),yMax );
+	return Address::Fetch( level,x,y );
+}
+
+template<class Address>
+Color Texture::SampleBilinear( const Level& level,const Vec2& t )
+{
+	// texel centers sit at half integer coordinates
+	// positions in 8 bit fixed point, the fraction is the blend weight
+	const int x = (int)std::floor( (t.x * float( level.width ) - 0.5f) * 256.0f );
+	const int y = (int)std::floor( (t.y * float( level.height ) - 0.5f) * 256.0f );
+	const unsigned int fx = (unsigned int)x & 0xFFu;
+	const unsigned int fy = (unsigned int)y & 0xFFu;
+	const int xFloor = x >> 8;
+	const int yFloor = y >> 8;
+
+	const int xMax = int( level.width ) - 1;
+	const int yMax = int( level.height ) - 1;
+	const int x0 = std::min( std::max( xFloor,0 ),xMax );
+	const int x1 = std::min( std::max( xFloor + 1,0 ),xMax );
+	const int y0 = std::min( std::max( yFloor,0 ),yMax );
+	const int y1 = std::min( std::max( yFloor + 1,0 ),yMax );
+
+	const Color top = LerpColor(
+		Address::Fetch( level,x0,y0 ),
+		Address::Fetch( level,x1,y0 ),fx );
+	const Color bottom = LerpColor(
+		Address::Fetch( level,x0,y1 ),
+		Address::Fetch( level,x1,y1 ),fx );
+	return LerpColor( top,bottom,fy );
+}
+
+template<class Address>
+Texture::Level Texture::Reorder( const Level& src,Layout srcLayout )
+{
+	Level dst;
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.tilesPerRow = Address::GetTilesPerRow( src.width );
+	dst.storage.resize( Address::GetStorageSize( src.width,src.height ) );
+	for( unsigned int y = 0u; y < src.height; y++ )
+	{
+		for( unsigned int x = 0u; x < src.width; x++ )
+		{
+			dst.storage[Address::Index( dst,x,y )] = FetchTexel( src,srcLayout,x,y );
+		}
+	}
+	dst.UseStorage();
+	return dst;
+}
+
+Color Texture::FetchTexel( const Level& level,Layout layout,unsigned int x,unsigned int y )
+{
+	switch( layout )
+	{
+	case Layout::Linear:
+		return LinearAddress::Fetch( level,x,y );
+	case Layout::Tiled:
+		return TiledAddress::Fetch( level,x,y );
+	case Layout::Morton:
+		return MortonAddress::Fetch( level,x,y );
+	default:
+		return Bc1Address::Fetch( level,x,y );
+	}
+}
+
+Texture::Level Texture::EncodeBc1( const Level& src )
+{
+	Level dst;
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.tilesPerRow = Bc1Address::GetTilesPerRow( src.width );
+	dst.storage.resize( Bc1Address::GetStorageSize( src.width,src.height ) );
+	const unsigned int blocksY = Bc1Address::GetTilesPerRow( src.height );
+	for( unsigned int by = 0u; by < blocksY; by++ )
+	{
+		for( unsigned int bx = 0u; bx < dst.tilesPerRow; bx++ )
+		{
+			// blocks past the edge repeat the last row / column
+			Color block[16];
+			for( unsigned int y = 0u; y < 4u; y++ )
+			{
+				const unsigned int sy = std::min( by * 4u + y,src.height - 1u );
+				for( unsigned int x = 0u; x < 4u; x++ )
+				{
+					block[y * 4u + x] = LinearAddress::Fetch( src,std::min( bx * 4u + x,src.width - 1u ),sy );
+				}
+			}
+			const size_t index = (size_t( by ) * dst.tilesPerRow + bx) * 2u;
+			Bc1Encoder::Encode( block,dst.storage[index].dword,dst.storage[index + 1u].dword );
+		}
+	}
+	dst.UseStorage();
+	return dst;
+}
+
+Texture::Level Texture::Downsample( const Level& src )
+{
+	Level dst;
+	dst.width = std::max( src.width / 2u,1u );
+	dst.height = std::max( src.height / 2u,1u );
+	dst.tilesPerRow = LinearAddress::GetTilesPerRow( dst.width );
+	dst.storage.resize( LinearAddress::GetStorageSize( dst.width,dst.height ) );
+	const unsigned int xMax = src.width - 1u;
+	const unsigned int yMax = src.height - 1u;
+	for( unsigned int y = 0u; y < dst.height; y++ )
+	{
+		// odd sizes clamp the last row/column instead of reading past the edge
+		const unsigned int sy0 = std::min( y * 2u,yMax );
+		const unsigned int sy1 = std::min( y * 2u + 1u,yMax );
+		for( unsigned int x = 0u; x < dst.width; x++ )
+		{
+			const unsigned int sx0 = std::min( x * 2u,xMax );
+			const unsigned int sx1 = std::min( x * 2u + 1u,xMax );
+			const Color c0 = src.texels[LinearAddress::Index( src,sx0,sy0 )];
+			const Color c1 = src.texels[LinearAddress::Index( src,sx1,sy0 )];
+			const Color c2 = src.texels[LinearAddress::Index( src,sx0,sy1 )];
+			const Color c3 = src.texels[LinearAddress::Index( src,sx1,sy1 )];
+			unsigned int result = 0u;
+			for( unsigned int shift = 0u; shift < 32u; shift += 8u )
+			{
+				const unsigned int sum =
+					((c0.dword >> shift) & 0xFFu) + ((c1.dword >> shift) & 0xFFu) +
+					((c2.dword >> shift) & 0xFFu) + ((c3.dword >> shift) & 0xFFu);
+				result |= ((sum + 2u) / 4u) << shift;
+			}
+			dst.storage[LinearAddress::Index( dst,x,y )] = result;
+		}
+	}
+	dst.UseStorage();
+	return dst;
+}
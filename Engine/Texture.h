@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Surface.h"
+#include "Vec2.h"
+#include "MappedFile.h"
+#include <vector>
+#include <string>
+#include <memory>
+
+// image with a precomputed mip chain and filtered sampling
+// texture coordinates are normalized (0 to 1 spans the texture) and clamped at the edges
+class Texture
+{
+public:
+	class Exception : public ChiliException
+	{
+	public:
+		using ChiliException::ChiliException;
+		virtual std::wstring GetFullMessage() const override { return GetNote() + L"\nAt: " + GetLocation(); }
+		virtual std::wstring GetExceptionType() const override { return L"Texture Exception"; }
+	};
+	enum class Filter
+	{
+		// nearest texel in the nearest mip level
+		Point,
+		// blend of 2x2 texels in the nearest mip level
+		Bilinear,
+		// bilinear in the two nearest mip levels, blended by the lod fraction
+		Trilinear
+	};
+	// how the texels of each level are ordered in memory
+	enum class Layout
+	{
+		// rows one after another, like a Surface
+		Linear,
+		// 4x4 texel tiles (one 64 byte cache line each), tiles row by row
+		Tiled,
+		// z-order (morton) curve inside 64x64 texel blocks, blocks row by row
+		Morton,
+		// 4x4 texel blocks compressed to 8 bytes (bc1 / dxt1: two 565 colors and 2 bit
+		// indices), blocks row by row, decoded on every fetch
+		// 1/8 the memory of the other layouts, alpha is kept as opaque / transparent only
+		Bc1
+	};
+public:
+	// builds the mip chain down to 1x1 from the base image
+	Texture( const Surface& base,Layout layout = Layout::Linear );
+	static Texture FromFile( const std::wstring& filename,Layout layout = Layout::Linear );
+	// decodes the files and builds their mip chains in parallel (in the order of the names)
+	static std::vector<Texture> FromFiles( const std::vector<std::wstring>& filenames,Layout layout = Layout::Linear );
+	// the baked cache of an image holds every level, already in its layout, as raw texels
+	// it sits next to the image and is memory mapped on load, so there is nothing to decode or copy
+	// (one file per layout, e.g. office_skin.jpg.morton.tex)
+	static std::wstring GetBakedName( const std::wstring& filename,Layout layout = Layout::Linear );
+	// decodes the image and (re)writes its baked cache (offline, or on first use)
+	static Texture Bake( const std::wstring& filename,Layout layout = Layout::Linear );
+	// maps a baked file, the levels point straight into the mapping
+	static Texture FromBakedFile( const std::wstring& bakedFilename );
+	// maps the baked cache if it matches the image and layout, bakes it otherwise
+	static Texture FromFileCached( const std::wstring& filename,Layout layout = Layout::Linear );
+	Texture( Texture&& ) = default;
+	Texture& operator=( Texture&& ) = default;
+	// reorders the texels of every level
+	// (to Bc1 they are compressed, which is lossy, so going back gives the decoded texels)
+	void SetLayout( Layout layout );
+	Layout GetLayout() const;
+	// level of detail for a pixel whose texture coordinates change by ddx and ddy
+	// per pixel step (log2 of the base level texels it covers along its longer axis)
+	float ComputeLod( const Vec2& ddx,const Vec2& ddy ) const;
+	// lod <= 0 samples the base level
+	Color Sample( const Vec2& t,float lod,Filter filter ) const;
+	size_t GetLevelCount() const;
+	unsigned int GetLevelWidth( size_t level ) const;
+	unsigned int GetLevelHeight( size_t level ) const;
+	Color GetTexel( size_t level,unsigned int x,unsigned int y ) const;
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	// memory taken by the texels of every level (mapped or owned)
+	size_t GetByteSize() const;
+private:
+	class Level
+	{
+	public:
+		Level() = default;
+		// texels may point into storage, so copies are not allowed (moves keep the buffer)
+		Level( const Level& ) = delete;
+		Level( Level&& ) = default;
+		Level& operator=( const Level& ) = delete;
+		Level& operator=( Level&& ) = default;
+		// makes texels point at storage after filling it
+		void UseStorage()
+		{
+			texels = storage.data();
+		}
+	public:
+		unsigned int width;
+		unsigned int height;
+		// tiles or blocks per row of the level, depending on the layout
+		unsigned int tilesPerRow;
+		// owned texels, empty when the level lives in a mapped baked file
+		std::vector<Color> storage;
+		const Color* texels = nullptr;
+	};
+	// texel index (and fetch) functions for each layout
+	class LinearAddress
+	{
+	public:
+		static size_t Index( const Level& level,unsigned int x,unsigned int y );
+		static Color Fetch( const Level& level,unsigned int x,unsigned int y )
+		{
+			return level.texels[Index( level,x,y )];
+		}
+		static unsigned int GetTilesPerRow( unsigned int width );
+		static size_t GetStorageSize( unsigned int width,unsigned int height );
+	};
+	class TiledAddress
+	{
+	public:
+		static constexpr unsigned int TileSize = 4u;
+		static size_t Index( const Level& level,unsigned int x,unsigned int y );
+		static Color Fetch( const Level& level,unsigned int x,unsigned int y )
+		{
+			return level.texels[Index( level,x,y )];
+		}
+		static unsigned int GetTilesPerRow( unsigned int width );
+		static size_t GetStorageSize( unsigned int width,unsigned int height );
+	};
+	class MortonAddress
+	{
+	public:
+		static constexpr unsigned int BlockSize = 64u;
+		static size_t Index( const Level& level,unsigned int x,unsigned int y );
+		static Color Fetch( const Level& level,unsigned int x,unsigned int y )
+		{
+			return level.texels[Index( level,x,y )];
+		}
+		static unsigned int GetTilesPerRow( unsigned int width );
+		static size_t GetStorageSize( unsigned int width,unsigned int height );
+	};
+	// each block is two words: the end colors (color 0 in the low half) and the indices
+	// (2 bits per texel, row by row from the lowest bits)
+	// no per texel index, levels are converted with EncodeBc1 instead of Reorder
+	class Bc1Address
+	{
+	public:
+		static constexpr unsigned int BlockSize = 4u;
+		static Color Fetch( const Level& level,unsigned int x,unsigned int y );
+		static unsigned int GetTilesPerRow( unsigned int width );
+		static size_t GetStorageSize( unsigned int width,unsigned int height );
+	};
+private:
+	template<class Address>
+	Color SampleLayout( const Vec2& t,float lod,Filter filter ) const;
+	template<class Address>
+	static Color SamplePoint( const Level& level,const Vec2& t );
+	template<class Address>
+	static Color SampleBilinear( const Level& level,const Vec2& t );
+	template<class Address>
+	static Level Reorder( const Level& src,Layout srcLayout );
+	// texel of a level in any layout
+	static Color FetchTexel( const Level& level,Layout layout,unsigned int x,unsigned int y );
+	// compresses a linear level (bake time, searches endpoints per block)
+	static Level EncodeBc1( const Level& src );
+	// next level of the chain (linear), each texel averages 2x2 source texels
+	static Level Downsample( const Level& src );
+	static size_t GetStorageSize( Layout layout,unsigned int width,unsigned int height );
+	// levels point into the mapping
+	Texture( std::unique_ptr<MappedFile> pMapping );
+	void WriteBaked( const std::wstring& bakedFilename,uint64_t sourceSize,int64_t sourceWriteTime ) const;
+private:
+	Layout layout = Layout::Linear;
+	std::vector<Level> levels;
+	// baked file the levels are mapped from (null when they own their texels)
+	std::unique_ptr<MappedFile> pMapping;
+};
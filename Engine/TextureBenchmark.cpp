@@ -0,0 +1,71 @@
+#include "TextureBenchmark.h"
+#include "ChiliMath.h"
+#include <chrono>
+#include <cmath>
+
+std::vector<TextureBenchmark::Result> TextureBenchmark::Run( const Surface& image,
+	Texture::Filter filter,int viewSize,int nAngles,int nRepeats )
+{
+	const Texture::Layout layouts[] = {
+		Texture::Layout::Linear,Texture::Layout::Tiled,Texture::Layout::Morton,Texture::Layout::Bc1
+	};
+	Texture tex( image );
+	const float texWidth = float( tex.GetWidth() );
+	const float texHeight = float( tex.GetHeight() );
+	// keeps the samples from being optimized away
+	unsigned int checksum = 0u;
+
+	std::vector<Result> results;
+	for( const auto layout : layouts )
+	{
+		tex.SetLayout( layout );
+		for( int a = 0; a < nAngles; a++ )
+		{
+			const float angle = nAngles > 1 ? (PI / 2.0f) * float( a ) / float( nAngles - 1 ) : 0.0f;
+			const float cosAngle = cos( angle );
+			const float sinAngle = sin( angle );
+			// texture coordinate change per pixel step in x and y
+			const Vec2 ddx = { cosAngle / texWidth,sinAngle / texHeight };
+			const Vec2 ddy = { -sinAngle / texWidth,cosAngle / texHeight };
+			const Vec2 origin = Vec2{ 0.5f,0.5f } -
+				ddx * (float( viewSize ) / 2.0f) - ddy * (float( viewSize ) / 2.0f);
+
+			const auto start = std::chrono::steady_clock::now();
+			for( int r = 0; r < nRepeats; r++ )
+			{
+				for( int y = 0; y < viewSize; y++ )
+				{
+					Vec2 t = origin + ddy * float( y );
+					for( int x = 0; x < viewSize; x++,t += ddx )
+					{
+						checksum += tex.Sample( t,0.0f,filter ).dword;
+					}
+				}
+			}
+			const std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - start;
+			results.push_back( { layout,angle,
+				elapsed.count() / (double( viewSize ) * viewSize * nRepeats) } );
+		}
+	}
+	// use the checksum so the sampling loop has an observable effect
+	if( checksum == 0xFFFFFFFFu )
+	{
+		results.clear();
+	}
+	return results;
+}
+
+const char* TextureBenchmark::GetLayoutName( Texture::Layout layout )
+{
+	switch( layout )
+	{
+	case Texture::Layout::Linear:
+		return "linear";
+	case Texture::Layout::Tiled:
+		return "tiled 4x4";
+	case Texture::Layout::Morton:
+		return "morton";
+	default:
+		return "bc1";
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Texture.h"
+#include <vector>
+
+// measures how fast each texture memory layout samples a rotated face
+// (a square screen region mapped onto the texture at some angle, one texel
+//  per pixel, so walking a row of pixels walks diagonally through texture memory)
+class TextureBenchmark
+{
+public:
+	class Result
+	{
+	public:
+		Texture::Layout layout;
+		// rotation of the face in radians
+		float angle;
+		double nanosecondsPerSample;
+	};
+public:
+	// runs every layout at nAngles angles evenly spread from 0 to 90 degrees
+	static std::vector<Result> Run( const Surface& image,
+		Texture::Filter filter = Texture::Filter::Bilinear,
+		int viewSize = 512,int nAngles = 7,int nRepeats = 4 );
+	static const char* GetLayoutName( Texture::Layout layout );
+};
@@ -0,0 +1,149 @@
+#include "TextureCache.h"
+
+namespace
+{
+	std::wstring MakeKey( const std::wstring& filename,Texture::Layout layout )
+	{
+		return filename + L'|' + std::to_wstring( int( layout ) );
+	}
+}
+
+TextureCache& TextureCache::Get()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::Handle TextureCache::Load( const std::wstring& filename,Texture::Layout layout )
+{
+	const std::wstring key = MakeKey( filename,layout );
+	std::promise<Handle> loaded;
+	{
+		std::unique_lock<std::mutex> lock( mtx );
+		const auto i = index.find( key );
+		if( i != index.end() )
+		{
+			nHits++;
+			entries.splice( entries.begin(),entries,i->second );
+			return i->second->pTexture;
+		}
+		const auto j = pending.find( key );
+		if( j != pending.end() )
+		{
+			// counted as a hit, the file is only loaded once
+			nHits++;
+			const std::shared_future<Handle> inFlight = j->second;
+			lock.unlock();
+			return inFlight.get();
+		}
+		nMisses++;
+		pending.emplace( key,loaded.get_future().share() );
+	}
+	Handle pTexture;
+	try
+	{
+		pTexture = std::make_shared<const Texture>( Texture::FromFileCached( filename,layout ) );
+	}
+	catch( ... )
+	{
+		// the waiting threads get the error too, the next load tries again
+		{
+			std::lock_guard<std::mutex> lock( mtx );
+			pending.erase( key );
+		}
+		loaded.set_exception( std::current_exception() );
+		throw;
+	}
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		pending.erase( key );
+		const size_t size = pTexture->GetByteSize();
+		entries.push_front( { key,pTexture,size } );
+		index.emplace( key,entries.begin() );
+		residentBytes += size;
+		if( budget != 0u )
+		{
+			EvictUnreferenced( budget );
+		}
+	}
+	loaded.set_value( pTexture );
+	return pTexture;
+}
+
+void TextureCache::SetBudget( size_t bytes )
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	budget = bytes;
+	if( budget != 0u )
+	{
+		EvictUnreferenced( budget );
+	}
+}
+
+size_t TextureCache::GetBudget() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return budget;
+}
+
+void TextureCache::Trim()
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	if( budget != 0u )
+	{
+		EvictUnreferenced( budget );
+	}
+}
+
+void TextureCache::Purge()
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	EvictUnreferenced( 0u );
+}
+
+size_t TextureCache::GetHitCount() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return nHits;
+}
+
+size_t TextureCache::GetMissCount() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return nMisses;
+}
+
+size_t TextureCache::GetEvictionCount() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return nEvictions;
+}
+
+size_t TextureCache::GetResidentBytes() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return residentBytes;
+}
+
+size_t TextureCache::GetResidentCount() const
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	return entries.size();
+}
+
+void TextureCache::EvictUnreferenced( size_t limit )
+{
+	// the cache holds one reference, anything above that is a live handle
+	// (a count of 1 cannot go up behind our back, new handles are only made under the lock)
+	for( auto i = entries.end(); i != entries.begin() && residentBytes > limit; )
+	{
+		--i;
+		if( i->pTexture.use_count() == 1 )
+		{
+			residentBytes -= i->size;
+			nEvictions++;
+			index.erase( i->key );
+			i = entries.erase( i );
+		}
+	}
+}
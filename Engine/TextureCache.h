@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Texture.h"
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <future>
+#include <string>
+
+// process-wide store of loaded textures, keyed by file name and layout
+// every user of a file shares one read-only copy of it
+// textures nobody holds a handle to stay resident (so rebinding them is free)
+// until the resident bytes go over the budget, then the least recently used are evicted
+// textures that are still referenced are never evicted, so the budget can be exceeded by those
+class TextureCache
+{
+public:
+	typedef std::shared_ptr<const Texture> Handle;
+public:
+	static TextureCache& Get();
+	TextureCache( const TextureCache& ) = delete;
+	TextureCache& operator=( const TextureCache& ) = delete;
+	// loads through Texture::FromFileCached on a miss, outside the lock so loads of
+	// different files run in parallel (a thread asking for a file that is being loaded
+	// waits for that load, which also keeps two threads from baking the same file)
+	Handle Load( const std::wstring& filename,Texture::Layout layout = Texture::Layout::Morton );
+	// 0 means no limit
+	void SetBudget( size_t bytes );
+	size_t GetBudget() const;
+	// evicts unreferenced textures until the budget is met
+	// (also done on every load, handles released in between are only noticed then)
+	void Trim();
+	// evicts every unreferenced texture
+	void Purge();
+	size_t GetHitCount() const;
+	size_t GetMissCount() const;
+	size_t GetEvictionCount() const;
+	size_t GetResidentBytes() const;
+	size_t GetResidentCount() const;
+private:
+	TextureCache() = default;
+	// evicts least recently used unreferenced textures until at most limit bytes are resident
+	// (lock must be held)
+	void EvictUnreferenced( size_t limit );
+private:
+	class Entry
+	{
+	public:
+		std::wstring key;
+		Handle pTexture;
+		size_t size;
+	};
+	mutable std::mutex mtx;
+	// most recently used first
+	std::list<Entry> entries;
+	std::unordered_map<std::wstring,std::list<Entry>::iterator> index;
+	// loads in progress
+	std::unordered_map<std::wstring,std::shared_future<Handle>> pending;
+	size_t budget = 256u * 1024u * 1024u;
+	size_t residentBytes = 0u;
+	size_t nHits = 0u;
+	size_t nMisses = 0u;
+	size_t nEvictions = 0u;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Pipeline.h"
+#include "Texture.h"
+#include "TextureCache.h"
 
 // basic texture effect
 class TextureEffect
@@ -72,32 +74,43 @@ public:
 	// invoked for each pixel of a triangle
 	// takes an input of attributes that are the
 	// result of interpolating vertex attributes
+	// (and their change per pixel in x and y, for picking the mip level)
 	// and outputs a color
 	class PixelShader
 	{
+	public:
+		// tells the pipeline to pass attribute derivatives
+		static constexpr bool UsesDerivatives = true;
 	public:
 		template<class Input>
 		Color operator()( const Input& in ) const
 		{
-			return pTex->GetPixel(
-				(unsigned int)std::min( in.t.x * tex_width + 0.5f,tex_xclamp ),
-				(unsigned int)std::min( in.t.y * tex_height + 0.5f,tex_yclamp )
-			);
+			return pTex->Sample( in.t,0.0f,filter );
+		}
+		template<class Input>
+		Color operator()( const Input& in,const Input& ddx,const Input& ddy ) const
+		{
+			return pTex->Sample( in.t,pTex->ComputeLod( ddx.t,ddy.t ),filter );
+		}
+		// texels are reordered into the given layout once, when the baked cache is made
+		// (z-order keeps the cost of a fetch the same at any face rotation)
+		// effects binding the same file share the copy held by the texture cache
+		void BindTexture( const std::wstring& filename,Texture::Layout layout = Texture::Layout::Morton )
+		{
+			pTex = TextureCache::Get().Load( filename,layout );
+		}
+		// for textures loaded up front (e.g. several at once with Texture::FromFiles)
+		void BindTexture( Texture texture )
+		{
+			pTex = std::make_shared<const Texture>( std::move( texture ) );
 		}
-		void BindTexture( const std::wstring& filename )
+		void SetFilter( Texture::Filter filter_in )
 		{
-			pTex = std::make_unique<Surface>( Surface::FromFile( filename ) );
-			tex_width = float( pTex->GetWidth() );
-			tex_height = float( pTex->GetHeight() );
-			tex_xclamp = tex_width - 1.0f;
-			tex_yclamp = tex_height - 1.0f;
+			filter = filter_in;
 		}
 	private:
-		std::unique_ptr<Surface> pTex;
-		float tex_width;
-		float tex_height;
-		float tex_xclamp;
-		float tex_yclamp;
+		TextureCache::Handle pTex;
+		Texture::Filter filter = Texture::Filter::Trilinear;
 	};
 public:
 	PixelShader ps;
@@ -26,11 +26,15 @@
 template <typename T>
 class _Vec3 : public _Vec2<T>
 {
+public:
+	// (members of a dependent base have to be named for standard compilers)
+	using _Vec2<T>::x;
+	using _Vec2<T>::y;
 public:
 	_Vec3() {}
 	_Vec3( T x,T y,T z )
 		:
-		_Vec2( x,y ),
+		_Vec2<T>( x,y ),
 		z( z )
 	{}
 	_Vec3( const _Vec3& vect )
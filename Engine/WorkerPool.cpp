@@ -0,0 +1,96 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool( unsigned int nThreads )
+	:
+	nextItem( 0u )
+{
+	if( nThreads == 0u )
+	{
+		nThreads = std::max( std::thread::hardware_concurrency(),1u );
+	}
+	// calling thread is the first worker
+	for( unsigned int i = 1u; i < nThreads; i++ )
+	{
+		workers.emplace_back( &WorkerPool::WorkerLoop,this );
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		quitting = true;
+	}
+	cvStart.notify_all();
+	for( auto& w : workers )
+	{
+		w.join();
+	}
+}
+
+void WorkerPool::ParallelFor( size_t count,const std::function<void( size_t )>& task )
+{
+	// not worth waking anybody up for a single item
+	if( workers.empty() || count <= 1u )
+	{
+		for( size_t i = 0u; i < count; i++ )
+		{
+			task( i );
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		pTask = &task;
+		itemCount = count;
+		nextItem = 0u;
+		busyWorkers = workers.size();
+		generation++;
+	}
+	cvStart.notify_all();
+
+	RunItems();
+
+	// wait for stragglers before the task goes out of scope
+	std::unique_lock<std::mutex> lock( mtx );
+	cvDone.wait( lock,[this]() { return busyWorkers == 0u; } );
+	pTask = nullptr;
+}
+
+void WorkerPool::WorkerLoop()
+{
+	unsigned int lastGeneration = 0u;
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mtx );
+			cvStart.wait( lock,[this,lastGeneration]()
+			{
+				return quitting || generation != lastGeneration;
+			} );
+			if( quitting )
+			{
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		RunItems();
+
+		std::lock_guard<std::mutex> lock( mtx );
+		if( --busyWorkers == 0u )
+		{
+			cvDone.notify_one();
+		}
+	}
+}
+
+void WorkerPool::RunItems()
+{
+	for( size_t i = nextItem++; i < itemCount; i = nextItem++ )
+	{
+		(*pTask)( i );
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <vector>
+
+// fixed set of worker threads for fork-join parallel loops
+// the calling thread joins in on the work, and ParallelFor
+// only returns once every item has been processed
+class WorkerPool
+{
+public:
+	// nThreads counts the calling thread too (0 means one per hardware thread)
+	WorkerPool( unsigned int nThreads = 0u );
+	WorkerPool( const WorkerPool& ) = delete;
+	WorkerPool& operator=( const WorkerPool& ) = delete;
+	~WorkerPool();
+	// invokes task( i ) once for every i in [0,count)
+	// items are handed out dynamically, so order of execution is unspecified
+	void ParallelFor( size_t count,const std::function<void( size_t )>& task );
+	unsigned int GetThreadCount() const
+	{
+		return (unsigned int)workers.size() + 1u;
+	}
+private:
+	void WorkerLoop();
+	void RunItems();
+private:
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable cvStart;
+	std::condition_variable cvDone;
+	const std::function<void( size_t )>* pTask = nullptr;
+	size_t itemCount = 0u;
+	std::atomic<size_t> nextItem;
+	size_t busyWorkers = 0u;
+	unsigned int generation = 0u;
+	bool quitting = false;
+};
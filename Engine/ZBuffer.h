@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <algorithm>
+#include <assert.h>
+
+// depth buffer for the pipeline's depth test
+// holds 1/z, which interpolates linearly in screen space, so larger values are
+// nearer and the cleared value of 0 is infinitely far away
+// also tracks the farthest depth of every 8x8 tile so whole tiles can be
+// rejected with one compare (hierarchical z)
+class ZBuffer
+{
+public:
+	// edge length of a coarse depth tile (pixels)
+	static constexpr int TileSize = 8;
+public:
+	ZBuffer( int width,int height )
+		:
+		width( width ),
+		height( height ),
+		tilesX( (width + TileSize - 1) / TileSize ),
+		tilesY( (height + TileSize - 1) / TileSize ),
+		pBuffer( std::make_unique<float[]>( width * height ) ),
+		pTileFar( std::make_unique<float[]>( tilesX * tilesY ) ),
+		pTileDirty( std::make_unique<bool[]>( tilesX * tilesY ) )
+	{
+		Clear();
+	}
+	ZBuffer( const ZBuffer& ) = delete;
+	ZBuffer& operator=( const ZBuffer& ) = delete;
+	void Clear()
+	{
+		std::fill_n( pBuffer.get(),width * height,0.0f );
+		std::fill_n( pTileFar.get(),tilesX * tilesY,0.0f );
+		std::fill_n( pTileDirty.get(),tilesX * tilesY,false );
+	}
+	// early z test: if zInv is nearer than what is stored at (x,y),
+	// store it and return true (pixel should be shaded)
+	bool TestAndSet( int x,int y,float zInv )
+	{
+		assert( x >= 0 );
+		assert( y >= 0 );
+		assert( x < width );
+		assert( y < height );
+		float& depth = pBuffer[y * width + x];
+		if( zInv > depth )
+		{
+			depth = zInv;
+			pTileDirty[(y / TileSize) * tilesX + x / TileSize] = true;
+			return true;
+		}
+		return false;
+	}
+	// true if a surface no nearer than nearestZInv fails the depth test
+	// at every pixel of tile (tx,ty)
+	bool IsTileOccluded( int tx,int ty,float nearestZInv )
+	{
+		return nearestZInv <= GetTileFar( tx,ty );
+	}
+	// farthest depth stored anywhere in tile (tx,ty)
+	// tiles written since the last query are rescanned here, so a tile is
+	// scanned at most once per query no matter how many pixels were written
+	float GetTileFar( int tx,int ty )
+	{
+		assert( tx >= 0 );
+		assert( ty >= 0 );
+		assert( tx < tilesX );
+		assert( ty < tilesY );
+		const int i = ty * tilesX + tx;
+		if( pTileDirty[i] )
+		{
+			const int xEnd = std::min( (tx + 1) * TileSize,width );
+			const int yEnd = std::min( (ty + 1) * TileSize,height );
+			float farthest = pBuffer[ty * TileSize * width + tx * TileSize];
+			for( int y = ty * TileSize; y < yEnd; y++ )
+			{
+				const float* pRow = &pBuffer[y * width];
+				for( int x = tx * TileSize; x < xEnd; x++ )
+				{
+					farthest = std::min( farthest,pRow[x] );
+				}
+			}
+			pTileFar[i] = farthest;
+			pTileDirty[i] = false;
+		}
+		return pTileFar[i];
+	}
+	float GetDepth( int x,int y ) const
+	{
+		assert( x >= 0 );
+		assert( y >= 0 );
+		assert( x < width );
+		assert( y < height );
+		return pBuffer[y * width + x];
+	}
+	int GetWidth() const
+	{
+		return width;
+	}
+	int GetHeight() const
+	{
+		return height;
+	}
+private:
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	std::unique_ptr<float[]> pBuffer;
+	std::unique_ptr<float[]> pTileFar;
+	std::unique_ptr<bool[]> pTileDirty;
+};